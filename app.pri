@@ -1,11 +1,45 @@
 SOURCES += \
     $$PWD/appwindow.cc \
     $$PWD/appobject.cc \
-    $$PWD/appobjecthandler.cc
+    $$PWD/appobjecthandler.cc \
+    $$PWD/appitemincubator.cc \
+    $$PWD/appobjectprefab.cc \
+    $$PWD/appobjectpool.cc \
+    $$PWD/appcomponentregistry.cc \
+    $$PWD/appmaintenancescheduler.cc \
+    $$PWD/appmemorymonitor.cc \
+    $$PWD/appresourceprovider.cc \
+    $$PWD/appimageprovider.cc \
+    $$PWD/appjobsystem.cc \
+    $$PWD/appheadlesswindow.cc \
+    $$PWD/appframeexporter.cc \
+    $$PWD/apprecorder.cc \
+    $$PWD/appreplayer.cc \
+    $$PWD/applogging.cc
 
 HEADERS += \
     $$PWD/appwindow.hh \
     $$PWD/appobject.hh \
-    $$PWD/appobjecthandler.hh
+    $$PWD/appobjecthandler.hh \
+    $$PWD/appitemincubator.hh \
+    $$PWD/appobjectprefab.hh \
+    $$PWD/appobjectpool.hh \
+    $$PWD/appcomponentregistry.hh \
+    $$PWD/appmaintenancescheduler.hh \
+    $$PWD/appmemorymonitor.hh \
+    $$PWD/appresourceprovider.hh \
+    $$PWD/appimageprovider.hh \
+    $$PWD/appjobsystem.hh \
+    $$PWD/appheadlesswindow.hh \
+    $$PWD/appframeexporter.hh \
+    $$PWD/apprecorder.hh \
+    $$PWD/appreplayer.hh \
+    $$PWD/applogging.hh
 
 INCLUDEPATH += $$PWD
+
+# The running animations are read from the unified animation timer of QtCore
+QT += core-private
+
+# shm_open() and shm_unlink() of the frame export, in librt before glibc 2.34
+linux: LIBS += -lrt
@@ -0,0 +1,231 @@
+#include "appcomponentregistry.hh"
+#include "applogging.hh"
+#include <QFileInfo>
+
+namespace
+{
+// A compiled component takes a multiple of its source size in memory; the
+// estimate is only meant for comparing and budgeting
+const qint64 COMPILED_SIZE_FACTOR = 4;
+const qint64 COMPONENT_OVERHEAD = 2048;
+
+/** Returns the size of the source file behind the URL, 0 if unknown. */
+qint64 sourceSize(const QUrl& url)
+{
+    if (url.scheme() == "qrc")
+    {
+        return QFileInfo(":"+url.path()).size();
+    }
+    if (url.isLocalFile())
+    {
+        return QFileInfo(url.toLocalFile()).size();
+    }
+    return 0;
+}
+}
+
+/*******************************************************************************
+ * CONSTRUCTOR AND DESTRUCTOR
+ */
+AppComponentRegistry::AppComponentRegistry()
+    : QObject()
+    , m_cacheCapacity(16)
+{
+}
+
+AppComponentRegistry::~AppComponentRegistry()
+{
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ */
+AppComponentRegistry* AppComponentRegistry::instance()
+{
+    static AppComponentRegistry registry;
+    return &registry;
+}
+
+QQmlComponent* AppComponentRegistry::acquire(QQmlEngine* engine,
+                                             const QUrl& url,
+                                             QQmlComponent::CompilationMode compilationMode)
+{
+    Key key(engine, url);
+    auto iter = m_entries.find(key);
+    if (iter != m_entries.end() && iter->component->isError()
+            && iter->references == 0 && iter->instances == 0)
+    {
+        // Give a failed component another chance, e.g. after a content update
+        m_unused.removeOne(key);
+        m_keys.remove(iter->component);
+        delete iter->component;
+        m_entries.erase(iter);
+        iter = m_entries.end();
+    }
+    if (iter == m_entries.end())
+    {
+        bool engineKnown = false;
+        for (auto entry = m_entries.constBegin(); entry != m_entries.constEnd(); ++entry)
+        {
+            if (entry.key().first == engine)
+            {
+                engineKnown = true;
+                break;
+            }
+        }
+        if (!engineKnown)
+        {
+            connect(engine, SIGNAL(destroyed(QObject*)),
+                    this, SLOT(engineDestroyed(QObject*)), Qt::UniqueConnection);
+        }
+        // The engine owns the component, so it never outlives the engine
+        Entry entry;
+        entry.component = new QQmlComponent(engine, url, compilationMode, engine);
+        entry.references = 0;
+        entry.instances = 0;
+        entry.sourceBytes = sourceSize(url);
+        iter = m_entries.insert(key, entry);
+        m_keys[entry.component] = key;
+    }
+    else if (iter->references == 0 && iter->instances == 0)
+    {
+        m_unused.removeOne(key);
+    }
+    ++iter->references;
+    return iter->component;
+}
+
+void AppComponentRegistry::release(QQmlComponent* component)
+{
+    if (!m_keys.contains(component))
+    {
+        appCWarning(lcAppComponents, QString()) << Q_FUNC_INFO << ": The component is not in the registry!";
+        return;
+    }
+    Key key = m_keys[component];
+    Entry& entry = m_entries[key];
+    if (entry.references > 0)
+    {
+        --entry.references;
+    }
+    releaseIfUnused(key);
+}
+
+void AppComponentRegistry::trackInstance(QQmlComponent* component, QObject* instance)
+{
+    auto key = m_keys.constFind(component);
+    if (key == m_keys.constEnd() || instance == 0 || m_instances.contains(instance))
+    {
+        return;
+    }
+    Entry& entry = m_entries[*key];
+    if (entry.references == 0 && entry.instances == 0)
+    {
+        m_unused.removeOne(*key);
+    }
+    ++entry.instances;
+    m_instances[instance] = component;
+    connect(instance, SIGNAL(destroyed(QObject*)),
+            this, SLOT(instanceDestroyed(QObject*)));
+}
+
+void AppComponentRegistry::setCacheCapacity(int capacity)
+{
+    m_cacheCapacity = capacity;
+    evict(m_cacheCapacity);
+}
+
+int AppComponentRegistry::purgeUnused()
+{
+    int count = m_unused.size();
+    evict(0);
+    return count;
+}
+
+AppComponentRegistry::Stats AppComponentRegistry::stats() const
+{
+    Stats stats;
+    stats.residentComponents = m_entries.size();
+    stats.unusedComponents = m_unused.size();
+    stats.liveInstances = m_instances.size();
+    stats.estimatedBytes = 0;
+    for (auto iter = m_entries.constBegin(); iter != m_entries.constEnd(); ++iter)
+    {
+        stats.estimatedBytes += iter->sourceBytes*COMPILED_SIZE_FACTOR+COMPONENT_OVERHEAD;
+    }
+    return stats;
+}
+
+/*******************************************************************************
+ * PRIVATE SLOTS
+ */
+void AppComponentRegistry::instanceDestroyed(QObject* instance)
+{
+    QQmlComponent* component = m_instances.take(instance);
+    if (!m_keys.contains(component))
+    {
+        return;
+    }
+    Key key = m_keys[component];
+    Entry& entry = m_entries[key];
+    if (entry.instances > 0)
+    {
+        --entry.instances;
+    }
+    releaseIfUnused(key);
+}
+
+void AppComponentRegistry::engineDestroyed(QObject* engine)
+{
+    // The engine deletes the components itself, only the bookkeeping is dropped
+    for (auto iter = m_entries.begin(); iter != m_entries.end();)
+    {
+        if (iter.key().first == engine)
+        {
+            m_keys.remove(iter->component);
+            m_unused.removeOne(iter.key());
+            iter = m_entries.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+    for (auto iter = m_instances.begin(); iter != m_instances.end();)
+    {
+        if (!m_keys.contains(iter.value()))
+        {
+            disconnect(iter.key(), 0, this, 0);
+            iter = m_instances.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+}
+
+/*******************************************************************************
+ * PRIVATE FUNCTIONS
+ */
+void AppComponentRegistry::releaseIfUnused(const Key& key)
+{
+    const Entry& entry = m_entries[key];
+    if (entry.references == 0 && entry.instances == 0 && !m_unused.contains(key))
+    {
+        m_unused.append(key);
+        evict(m_cacheCapacity);
+    }
+}
+
+void AppComponentRegistry::evict(int capacity)
+{
+    while (m_unused.size() > capacity)
+    {
+        Key key = m_unused.takeFirst();
+        Entry entry = m_entries.take(key);
+        m_keys.remove(entry.component);
+        // Deferred, as the component may be in the middle of emitting a signal
+        entry.component->deleteLater();
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef APPCOMPONENTREGISTRY_HH
+#define APPCOMPONENTREGISTRY_HH
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QUrl>
+#include <QQmlComponent>
+#include <QQmlEngine>
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppComponentRegistry is the process-wide cache of compiled
+/// QQmlComponents, shared by all the AppObjectHandlers and AppWindows. A
+/// component is identified by its engine and resolved URL and compiled exactly
+/// once. It is kept alive as long as it is referenced by a handler or view, or
+/// by a live object created from it. When the last user goes away the
+/// component is moved to an LRU list of unused components and deleted only
+/// when the list grows beyond its capacity.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppComponentRegistry : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** Statistics of the resident components. */
+    struct Stats
+    {
+        int residentComponents;  ///< Compiled components in memory
+        int unusedComponents;    ///< Resident components without any users
+        int liveInstances;       ///< Live objects created from the components
+        qint64 estimatedBytes;   ///< Rough estimate of the memory used by the components
+    };
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    /** Returns the registry of the process. */
+    static AppComponentRegistry* instance();
+
+    /**
+     * Returns the component of the URL, compiling it if it is not resident,
+     * and adds a reference to it.
+     * @param engine The engine the component is compiled with
+     * @param url The resolved URL of the component
+     * @param compilationMode Used only when the component is compiled
+     */
+    QQmlComponent* acquire(QQmlEngine* engine,
+                           const QUrl& url,
+                           QQmlComponent::CompilationMode compilationMode=QQmlComponent::Asynchronous);
+
+    /** Removes a reference added by acquire(). */
+    void release(QQmlComponent* component);
+
+    /**
+     * Keeps the component resident as long as the object created from it is
+     * alive.
+     */
+    void trackInstance(QQmlComponent* component, QObject* instance);
+
+    /** Sets the number of unused components kept compiled. */
+    void setCacheCapacity(int capacity);
+    int getCacheCapacity() const {return m_cacheCapacity;}
+
+    /** Deletes all the unused components. Returns the number deleted. */
+    int purgeUnused();
+
+    Stats stats() const;
+
+private slots:
+    /***************************************************************************
+     * PRIVATE SLOTS
+     */
+    void instanceDestroyed(QObject* instance);
+    void engineDestroyed(QObject* engine);
+
+private:
+    typedef QPair<QQmlEngine*, QUrl> Key;
+
+    /** A resident component and its users. */
+    struct Entry
+    {
+        QQmlComponent* component;
+        int references;     ///< References from acquire()
+        int instances;      ///< Live objects created from the component
+        qint64 sourceBytes; ///< Size of the QML source, used for the memory estimate
+    };
+
+    /***************************************************************************
+     * PRIVATE FUNCTIONS
+     */
+    AppComponentRegistry();
+    virtual ~AppComponentRegistry();
+
+    /** Moves the component to the unused list if it has no users left. */
+    void releaseIfUnused(const Key& key);
+
+    /** Deletes unused components beyond the cache capacity. */
+    void evict(int capacity);
+
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    QHash<Key, Entry> m_entries;                    ///< The resident components
+    QHash<QQmlComponent*, Key> m_keys;              ///< Reverse lookup of the entries
+    QHash<QObject*, QQmlComponent*> m_instances;    ///< The component of each tracked instance
+    QList<Key> m_unused;                            ///< Unused components, least recently used first
+    int m_cacheCapacity;
+};
+
+#endif // APPCOMPONENTREGISTRY_HH
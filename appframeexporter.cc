@@ -0,0 +1,396 @@
+#include "appframeexporter.hh"
+#include "appwindow.hh"
+#include "applogging.hh"
+#include <QElapsedTimer>
+#include <QRunnable>
+#include <QPointer>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
+#include <QSGRendererInterface>
+#include <new>
+#include <cstring>
+
+#if defined(Q_OS_LINUX)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+namespace
+{
+// Keeps the pixels of each slot aligned for fast copies
+const qint64 SLOT_ALIGNMENT = 64;
+
+qint64 align(qint64 size)
+{
+    return (size+SLOT_ALIGNMENT-1)/SLOT_ALIGNMENT*SLOT_ALIGNMENT;
+}
+
+// A frame is exported when the next one is read back
+const int BUFFER_COUNT = 2;
+
+// How long the last frame may wait in its pixel buffer for a next frame
+const int FLUSH_DELAY = 100;
+
+/** Publishes the frame left in a pixel buffer, on the render thread. */
+class FlushJob : public QRunnable
+{
+public:
+    explicit FlushJob(AppFrameExporter* exporter) : m_exporter(exporter) {}
+
+    virtual void run()
+    {
+        if (m_exporter)
+        {
+            m_exporter->flushPendingFrame();
+        }
+    }
+
+private:
+    QPointer<AppFrameExporter> m_exporter;
+};
+
+#if defined(Q_OS_LINUX)
+qint64 monotonicNsec()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return qint64(now.tv_sec)*1000000000+now.tv_nsec;
+}
+#endif
+}
+
+/*******************************************************************************
+ * CONSTRUCTOR AND DESTRUCTOR
+ */
+AppFrameExporter::AppFrameExporter(AppWindow* window)
+    : QObject(window)
+    , m_window(window)
+    , m_memory(0)
+    , m_memorySize(0)
+    , m_frameNumber(0)
+    , m_readbackReset(false)
+    , m_nextBuffer(0)
+{
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FLUSH_DELAY);
+    connect(&m_flushTimer, SIGNAL(timeout()), this, SLOT(requestFlush()));
+    // Direct, as the frame must be read back on the render thread while the
+    // context is current
+    connect(m_window, SIGNAL(afterRendering()), this, SLOT(readBack()), Qt::DirectConnection);
+    connect(m_window, SIGNAL(sceneGraphInvalidated()), this, SLOT(releaseBuffers()), Qt::DirectConnection);
+    // The window is only read on the GUI thread
+    connect(m_window, SIGNAL(widthChanged(int)), this, SLOT(updateWindowSize()));
+    connect(m_window, SIGNAL(heightChanged(int)), this, SLOT(updateWindowSize()));
+    connect(m_window, SIGNAL(screenChanged(QScreen*)), this, SLOT(updateWindowSize()));
+    updateWindowSize();
+}
+
+AppFrameExporter::~AppFrameExporter()
+{
+    stop();
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ */
+bool AppFrameExporter::start(const QString &name, int slotCount)
+{
+    QMutexLocker locker(&m_mutex);
+    release();
+#if defined(Q_OS_LINUX)
+    if (m_window->rendererInterface()->graphicsApi() != QSGRendererInterface::OpenGL)
+    {
+        appCWarning(lcAppCapture, QString()) << Q_FUNC_INFO << ": The frames can only be exported from the OpenGL backend";
+        return false;
+    }
+    m_frameSize = m_window->size()*m_window->effectiveDevicePixelRatio();
+    qint64 stride = m_frameSize.width()*4;
+    qint64 slotSize = align(sizeof(SlotHeader))+align(stride*m_frameSize.height());
+    m_memorySize = align(sizeof(RingHeader))+slotSize*slotCount;
+    m_shmName = "/app-frames-"+name;
+    QByteArray shmName = m_shmName.toLocal8Bit();
+    int fd = shm_open(shmName.constData(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        appCWarning(lcAppCapture, m_shmName) << Q_FUNC_INFO << ": Cannot create the shared memory "+m_shmName;
+        return false;
+    }
+    void* memory = MAP_FAILED;
+    if (ftruncate(fd, m_memorySize) == 0)
+    {
+        memory = mmap(0, m_memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        appCWarning(lcAppCapture, m_shmName) << Q_FUNC_INFO << ": Cannot map the shared memory "+m_shmName;
+        shm_unlink(shmName.constData());
+        return false;
+    }
+    m_memory = static_cast<uchar*>(memory);
+    RingHeader* header = new (m_memory) RingHeader;
+    header->magic = MAGIC;
+    header->version = VERSION;
+    header->slotCount = slotCount;
+    header->width = m_frameSize.width();
+    header->height = m_frameSize.height();
+    header->stride = stride;
+    header->slotSize = slotSize;
+    header->latestFrame.store(0);
+    header->consumedFrame.store(0);
+    for (int i = 0; i < slotCount; ++i)
+    {
+        uchar* slot = m_memory+align(sizeof(RingHeader))+slotSize*i;
+        SlotHeader* slotHeader = new (slot) SlotHeader;
+        slotHeader->sequence.store(0);
+        slotHeader->frameNumber = 0;
+        slotHeader->timestampNsec = 0;
+    }
+    m_frameNumber = 0;
+    m_readbackReset = true;
+    return true;
+#else
+    Q_UNUSED(name);
+    Q_UNUSED(slotCount);
+    appCWarning(lcAppCapture, QString()) << Q_FUNC_INFO << ": The frame export is only supported on Linux";
+    return false;
+#endif
+}
+
+void AppFrameExporter::stop()
+{
+    QMutexLocker locker(&m_mutex);
+    release();
+}
+
+bool AppFrameExporter::isRunning() const
+{
+    return m_memory != 0;
+}
+
+qint64 AppFrameExporter::getAverageReadbackTime() const
+{
+    quint64 frames = m_exportedFrames.load();
+    return frames > 0 ? m_totalReadbackNsec.load()/qint64(frames) : 0;
+}
+
+/*******************************************************************************
+ * PRIVATE SLOTS
+ */
+void AppFrameExporter::readBack()
+{
+#if defined(Q_OS_LINUX)
+    // A frame that arrives while the export is reconfigured is dropped
+    // rather than waited for
+    if (!m_mutex.tryLock())
+    {
+        m_droppedFrames.ref();
+        return;
+    }
+    if (!m_memory)
+    {
+        m_mutex.unlock();
+        return;
+    }
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    QSize frameSize(m_windowWidth.load(), m_windowHeight.load());
+    if (!context || frameSize != m_frameSize)
+    {
+        m_droppedFrames.ref();
+        m_mutex.unlock();
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    if (context->format().version() >= qMakePair(3, 0))
+    {
+        readBackAsync(context);
+    }
+    else
+    {
+        uchar* pixels = 0;
+        SlotHeader* slotHeader = beginSlot(pixels);
+        context->functions()->glReadPixels(0, 0, m_frameSize.width(), m_frameSize.height(),
+                                           GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        endSlot(slotHeader, monotonicNsec());
+    }
+    qint64 elapsed = timer.nsecsElapsed();
+
+    m_lastReadbackNsec.store(elapsed);
+    m_totalReadbackNsec.fetchAndAddRelaxed(elapsed);
+    m_mutex.unlock();
+#endif
+}
+
+void AppFrameExporter::flushPendingFrame()
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if (!context || !m_mutex.tryLock())
+    {
+        return;
+    }
+    if (m_memory && !m_readbackReset && m_bufferSize == m_frameSize)
+    {
+        QOpenGLExtraFunctions* gl = context->extraFunctions();
+        // The oldest frame first, though only the last one can be left
+        for (int i = 1; i <= m_bufferTimestamps.size(); ++i)
+        {
+            publishBuffer(gl, (m_nextBuffer+i) % m_bufferTimestamps.size());
+        }
+        gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    m_mutex.unlock();
+}
+
+void AppFrameExporter::scheduleFlush()
+{
+    m_flushTimer.start();
+}
+
+void AppFrameExporter::requestFlush()
+{
+    // Run on the render thread with the context current, without a new frame
+    m_window->scheduleRenderJob(new FlushJob(this), QQuickWindow::NoStage);
+}
+
+void AppFrameExporter::updateWindowSize()
+{
+    QSize size = m_window->size()*m_window->effectiveDevicePixelRatio();
+    m_windowWidth.store(size.width());
+    m_windowHeight.store(size.height());
+}
+
+void AppFrameExporter::releaseBuffers()
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if (context && !m_buffers.isEmpty())
+    {
+        context->functions()->glDeleteBuffers(m_buffers.size(), m_buffers.constData());
+    }
+    m_buffers.clear();
+    m_bufferTimestamps.clear();
+    m_bufferSize = QSize();
+}
+
+/*******************************************************************************
+ * PRIVATE FUNCTIONS
+ */
+void AppFrameExporter::release()
+{
+#if defined(Q_OS_LINUX)
+    if (m_memory)
+    {
+        munmap(m_memory, m_memorySize);
+        shm_unlink(m_shmName.toLocal8Bit().constData());
+        m_memory = 0;
+        m_memorySize = 0;
+    }
+#endif
+}
+
+AppFrameExporter::SlotHeader* AppFrameExporter::beginSlot(uchar*& pixels)
+{
+    RingHeader* header = reinterpret_cast<RingHeader*>(m_memory);
+    quint64 frameNumber = ++m_frameNumber;
+    // The slot about to be overwritten holds a frame the consumer has not read
+    quint64 consumed = header->consumedFrame.load();
+    if (frameNumber > header->slotCount && consumed <= frameNumber-header->slotCount-1)
+    {
+        m_droppedFrames.ref();
+    }
+    uchar* slot = m_memory+align(sizeof(RingHeader))
+            +header->slotSize*((frameNumber-1) % header->slotCount);
+    SlotHeader* slotHeader = reinterpret_cast<SlotHeader*>(slot);
+    pixels = slot+align(sizeof(SlotHeader));
+    slotHeader->sequence.fetchAndAddOrdered(1);
+    return slotHeader;
+}
+
+void AppFrameExporter::endSlot(SlotHeader* slotHeader, qint64 timestampNsec)
+{
+    RingHeader* header = reinterpret_cast<RingHeader*>(m_memory);
+    slotHeader->frameNumber = m_frameNumber;
+    slotHeader->timestampNsec = timestampNsec;
+    slotHeader->sequence.fetchAndAddOrdered(1);
+    header->latestFrame.storeRelease(m_frameNumber);
+    m_exportedFrames.ref();
+}
+
+void AppFrameExporter::readBackAsync(QOpenGLContext* context)
+{
+#if defined(Q_OS_LINUX)
+    QOpenGLExtraFunctions* gl = context->extraFunctions();
+    qint64 frameBytes = qint64(m_frameSize.width())*4*m_frameSize.height();
+    if (m_bufferSize != m_frameSize)
+    {
+        releaseBuffers();
+        m_buffers.resize(BUFFER_COUNT);
+        gl->glGenBuffers(BUFFER_COUNT, m_buffers.data());
+        for (auto iter = m_buffers.constBegin(); iter != m_buffers.constEnd(); ++iter)
+        {
+            gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, *iter);
+            gl->glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, 0, GL_STREAM_READ);
+        }
+        m_bufferTimestamps.fill(0, BUFFER_COUNT);
+        m_bufferSize = m_frameSize;
+        m_nextBuffer = 0;
+    }
+    if (m_readbackReset)
+    {
+        // The frame in flight belongs to the previous export
+        m_bufferTimestamps.fill(0);
+        m_readbackReset = false;
+    }
+
+    // Queues the transfer of this frame without waiting for it
+    int current = m_nextBuffer;
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffers[current]);
+    gl->glReadPixels(0, 0, m_frameSize.width(), m_frameSize.height(),
+                     GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    m_bufferTimestamps[current] = monotonicNsec();
+
+    // The transfer of the previous frame has had a frame to complete
+    m_nextBuffer = (current+1) % BUFFER_COUNT;
+    publishBuffer(gl, m_nextBuffer);
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // Published by a flush unless another frame follows soon
+    QMetaObject::invokeMethod(this, "scheduleFlush", Qt::QueuedConnection);
+#else
+    Q_UNUSED(context);
+#endif
+}
+
+void AppFrameExporter::publishBuffer(QOpenGLExtraFunctions* gl, int index)
+{
+#if defined(Q_OS_LINUX)
+    if (m_bufferTimestamps[index] == 0)
+    {
+        return;
+    }
+    qint64 frameBytes = qint64(m_bufferSize.width())*4*m_bufferSize.height();
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffers[index]);
+    void* mapped = gl->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT);
+    if (mapped)
+    {
+        uchar* pixels = 0;
+        SlotHeader* slotHeader = beginSlot(pixels);
+        memcpy(pixels, mapped, frameBytes);
+        endSlot(slotHeader, m_bufferTimestamps[index]);
+        gl->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    else
+    {
+        m_droppedFrames.ref();
+    }
+    m_bufferTimestamps[index] = 0;
+#else
+    Q_UNUSED(gl);
+    Q_UNUSED(index);
+#endif
+}
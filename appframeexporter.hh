@@ -0,0 +1,182 @@
+#ifndef APPFRAMEEXPORTER_HH
+#define APPFRAMEEXPORTER_HH
+
+#include <QObject>
+#include <QMutex>
+#include <QAtomicInteger>
+#include <QSize>
+#include <QVector>
+#include <QTimer>
+#include <qopengl.h>
+class AppWindow;
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppFrameExporter copies every rendered frame of an AppWindow into a
+/// ring of slots in POSIX shared memory, where recording and monitoring
+/// tools on the same machine map them without further copies. The frame is
+/// read back on the render thread, right after rendering, into one of two
+/// pixel buffer objects, and copied into the next slot a frame later, when
+/// the transfer has completed, so rendering never stalls on the readback.
+/// A frame thus reaches the ring one frame late. As Qt Quick renders only on
+/// changes, the last frame of a still scene would never be followed; it is
+/// published by itself when no frame follows within 100 ms. Contexts older than OpenGL 3.0 or OpenGL ES 3.0 read the frame back
+/// synchronously instead. The render thread never waits for the consumers:
+/// each slot is guarded by a sequence counter that is odd while the slot is
+/// written, so a consumer detects a slot overwritten under it and reads it
+/// again.
+///
+/// The shared memory object "/app-frames-<name>" starts with a RingHeader
+/// followed by slotCount slots, each a SlotHeader and the pixels. The
+/// pixels are RGBA, 8 bits per channel, bottom row first as read from
+/// OpenGL. A consumer stores the number of the last frame it has read in
+/// consumedFrame, which lets the exporter count the frames it overwrote
+/// before they were read.
+///
+/// Requires Linux and the OpenGL scene graph backend.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppFrameExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** The header of the shared memory object. */
+    struct RingHeader
+    {
+        quint32 magic;              ///< MAGIC
+        quint32 version;            ///< VERSION
+        quint32 slotCount;
+        quint32 width;              ///< In pixels
+        quint32 height;
+        quint32 stride;             ///< Bytes per row
+        quint64 slotSize;           ///< Bytes per slot including its header
+        QAtomicInteger<quint64> latestFrame;    ///< Number of the newest complete frame, 0 if none
+        QAtomicInteger<quint64> consumedFrame;  ///< Written by the consumer
+    };
+
+    /** The header of a slot. */
+    struct SlotHeader
+    {
+        QAtomicInteger<quint32> sequence;   ///< Odd while the slot is written
+        quint32 reserved;
+        quint64 frameNumber;                ///< Starts from 1
+        qint64 timestampNsec;               ///< CLOCK_MONOTONIC when the frame was read back
+    };
+
+    static const quint32 MAGIC = 0x41505046;    // "APPF"
+    static const quint32 VERSION = 1;
+
+    /***************************************************************************
+     * CONSTRUCTOR AND DESTRUCTOR
+     */
+    /**
+     * @param window The window whose frames are exported
+     */
+    explicit AppFrameExporter(AppWindow* window);
+
+    /** Stops the export and removes the shared memory. */
+    virtual ~AppFrameExporter();
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    /**
+     * Creates the shared memory for the current size of the window and starts
+     * exporting. Frames of another size are dropped, so restart the export
+     * after resizing the window.
+     * @param name The name of the ring, "/app-frames-<name>" in shared memory
+     * @param slotCount The number of frames in the ring
+     * @return False if the shared memory cannot be created
+     */
+    bool start(const QString& name, int slotCount=4);
+
+    /** Stops exporting and removes the shared memory. */
+    void stop();
+
+    bool isRunning() const;
+
+    /** Returns the number of frames written to the ring. */
+    quint64 getExportedFrames() const {return m_exportedFrames.load();}
+
+    /** Returns the number of frames not exported or overwritten unread. */
+    quint64 getDroppedFrames() const {return m_droppedFrames.load();}
+
+    /** Returns the duration of the last readback in nanoseconds. */
+    qint64 getLastReadbackTime() const {return m_lastReadbackNsec.load();}
+
+    /** Returns the average duration of the readbacks in nanoseconds. */
+    qint64 getAverageReadbackTime() const;
+
+    /** Publishes the frame left in a pixel buffer when no frame followed it.
+     * Called on the render thread with the context current. */
+    void flushPendingFrame();
+
+private slots:
+    /***************************************************************************
+     * PRIVATE SLOTS
+     */
+    /** Reads the frame back into the next slot. Called on the render thread. */
+    void readBack();
+
+    /** Caches the size of the window for the render thread. */
+    void updateWindowSize();
+
+    /** Restarts the wait for the frame after the one in flight. */
+    void scheduleFlush();
+
+    /** Schedules flushPendingFrame() on the render thread. */
+    void requestFlush();
+
+    /** Deletes the pixel buffer objects. Called on the render thread. */
+    void releaseBuffers();
+
+private:
+    /***************************************************************************
+     * PRIVATE FUNCTIONS
+     */
+    /** Unmaps and removes the shared memory. Call with m_mutex locked. */
+    void release();
+
+    /** Starts writing the next slot and returns its pixels. Call with
+     * m_mutex locked. */
+    SlotHeader* beginSlot(uchar*& pixels);
+
+    /** Completes the slot started with beginSlot(). */
+    void endSlot(SlotHeader* slotHeader, qint64 timestampNsec);
+
+    /** Reads the frame back through the pixel buffer objects and exports the
+     * previous one. */
+    void readBackAsync(QOpenGLContext* context);
+
+    /** Copies the frame in the pixel buffer into the next slot, if any. */
+    void publishBuffer(QOpenGLExtraFunctions* gl, int index);
+
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    AppWindow* m_window;
+    QMutex m_mutex;                     ///< Guards the mapping, never waited for on the render thread
+    QString m_shmName;
+    uchar* m_memory;                    ///< The mapped shared memory, null when stopped
+    qint64 m_memorySize;
+    QSize m_frameSize;                  ///< In device pixels
+    QAtomicInt m_windowWidth;           ///< In device pixels, cached on the GUI thread
+    QAtomicInt m_windowHeight;
+    quint64 m_frameNumber;              ///< Only used on the render thread
+    bool m_readbackReset;               ///< Set by start() to discard the frame in flight
+    QVector<GLuint> m_buffers;          ///< Pixel buffer objects, only used on the render thread
+    QVector<qint64> m_bufferTimestamps; ///< Of the frame in each buffer, 0 if none
+    int m_nextBuffer;
+    QSize m_bufferSize;
+    QTimer m_flushTimer;                ///< Publishes the frame in flight when no frame follows
+    QAtomicInteger<quint64> m_exportedFrames;
+    QAtomicInteger<quint64> m_droppedFrames;
+    QAtomicInteger<qint64> m_lastReadbackNsec;
+    QAtomicInteger<qint64> m_totalReadbackNsec;
+};
+
+#endif // APPFRAMEEXPORTER_HH
@@ -0,0 +1,222 @@
+#include "appheadlesswindow.hh"
+#include "applogging.hh"
+#include <QQuickRenderControl>
+#include <QSGRendererInterface>
+#include <QCoreApplication>
+
+namespace
+{
+// QQuickImageBase::Loading
+const int IMAGE_LOADING = 2;
+
+/** Returns true if an image in the subtree of the item is still loading. */
+bool hasLoadingImages(QQuickItem* item)
+{
+    QList<QQuickItem*> items = item->findChildren<QQuickItem*>();
+    items.append(item);
+    for (auto iter = items.constBegin(); iter != items.constEnd(); ++iter)
+    {
+        if ((*iter)->inherits("QQuickImageBase")
+                && (*iter)->property("status").toInt() == IMAGE_LOADING)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+}
+
+/*******************************************************************************
+ * CONSTRUCTOR AND DESTRUCTOR
+ */
+AppHeadlessWindow::AppHeadlessWindow(const QString& rootFolderPath,
+                                     const QString& mainQML,
+                                     const QSize& size)
+    : AppHeadlessWindow(createRenderControl(), rootFolderPath, mainQML, size)
+{
+}
+
+AppHeadlessWindow::AppHeadlessWindow(QQuickRenderControl* renderControl,
+                                     const QString& rootFolderPath,
+                                     const QString& mainQML,
+                                     const QSize& size)
+    : AppWindow(renderControl, rootFolderPath, mainQML, size)
+    , m_renderControl(renderControl)
+    , m_mainView(mainQML)
+    , m_nextJobId(0)
+    , m_loadTimeout(5000)
+{
+    m_clock.start();
+    resetStats();
+    m_renderControl->initialize(0);
+    // A window without frames has no incubation controller of its own
+    if (!engine()->incubationController())
+    {
+        engine()->setIncubationController(&m_incubationController);
+    }
+}
+
+AppHeadlessWindow::~AppHeadlessWindow()
+{
+    if (engine() && engine()->incubationController() == &m_incubationController)
+    {
+        engine()->setIncubationController(0);
+    }
+    delete m_renderControl;
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ */
+int AppHeadlessWindow::enqueue(const QString &viewName, const QVariantMap &state)
+{
+    Job job;
+    job.id = m_nextJobId++;
+    job.viewName = viewName;
+    job.state = state;
+    job.queuedAt = m_clock.nsecsElapsed();
+    m_jobs.append(job);
+    return job.id;
+}
+
+void AppHeadlessWindow::renderAll()
+{
+    qint64 started = m_clock.nsecsElapsed();
+    int rendered = 0;
+    while (!m_jobs.isEmpty())
+    {
+        Job job = m_jobs.takeFirst();
+        qint64 latency = 0;
+        QImage image = renderJob(job, latency);
+        ++rendered;
+        emit jobRendered(job.id, image, latency);
+    }
+    qint64 elapsed = m_clock.nsecsElapsed()-started;
+    if (rendered > 0 && elapsed > 0)
+    {
+        m_stats.rendersPerSecond = rendered*1000000000.0/elapsed;
+    }
+    emit queueFinished();
+}
+
+QImage AppHeadlessWindow::render(const QString &viewName, const QVariantMap &state)
+{
+    Job job;
+    job.id = -1;
+    job.viewName = viewName;
+    job.state = state;
+    job.queuedAt = m_clock.nsecsElapsed();
+    qint64 latency = 0;
+    return renderJob(job, latency);
+}
+
+void AppHeadlessWindow::setLoadTimeout(int msec)
+{
+    m_loadTimeout = msec;
+}
+
+void AppHeadlessWindow::resetStats()
+{
+    m_stats.renders = 0;
+    m_stats.totalRenderNsec = 0;
+    m_stats.totalLatencyNsec = 0;
+    m_stats.maxLatencyNsec = 0;
+    m_stats.rendersPerSecond = 0;
+}
+
+/*******************************************************************************
+ * PRIVATE FUNCTIONS
+ */
+QQuickRenderControl* AppHeadlessWindow::createRenderControl()
+{
+    if (QQuickWindow::sceneGraphBackend().isEmpty())
+    {
+        QQuickWindow::setSceneGraphBackend(QSGRendererInterface::Software);
+    }
+    else if (QQuickWindow::sceneGraphBackend() != "software")
+    {
+        appCWarning(lcAppCapture, QString()) << Q_FUNC_INFO << ": The scene graph backend "+QQuickWindow::sceneGraphBackend()
+                                             +" is selected, rendering may need a GPU";
+    }
+    return new QQuickRenderControl();
+}
+
+QImage AppHeadlessWindow::renderJob(const Job &job, qint64 &latency)
+{
+    // Every job is counted, also the failed ones, so the averages hold
+    qint64 started = m_clock.nsecsElapsed();
+    QImage image = grabJob(job);
+    qint64 finished = m_clock.nsecsElapsed();
+    latency = finished-job.queuedAt;
+    ++m_stats.renders;
+    m_stats.totalRenderNsec += finished-started;
+    m_stats.totalLatencyNsec += latency;
+    m_stats.maxLatencyNsec = qMax(m_stats.maxLatencyNsec, latency);
+    return image;
+}
+
+QImage AppHeadlessWindow::grabJob(const Job &job)
+{
+    if (!getLoadedViews().contains(job.viewName))
+    {
+        loadView(job.viewName, QQmlComponent::PreferSynchronous);
+    }
+    QQuickItem* view = getView(job.viewName);
+    if (!view)
+    {
+        appCWarning(lcAppCapture, job.viewName) << Q_FUNC_INFO << ": The view "+job.viewName+" cannot be loaded!";
+        return QImage();
+    }
+    // The main view holds the layers, so it stays under the rendered view
+    QStringList views = getLoadedViews();
+    for (auto iter = views.constBegin(); iter != views.constEnd(); ++iter)
+    {
+        if (*iter != job.viewName && *iter != m_mainView)
+        {
+            hideView(*iter);
+        }
+    }
+    showView(job.viewName);
+    // The state is undone after the grab, so the output of a job does not
+    // depend on the jobs before it
+    QVariantMap previous;
+    for (auto iter = job.state.constBegin(); iter != job.state.constEnd(); ++iter)
+    {
+        QByteArray name = iter.key().toUtf8();
+        previous[iter.key()] = view->property(name.constData());
+        view->setProperty(name.constData(), iter.value());
+    }
+    waitUntilLoaded(job.viewName);
+    m_renderControl->polishItems();
+    m_renderControl->sync();
+    QImage image = m_renderControl->grab();
+    for (auto iter = previous.constBegin(); iter != previous.constEnd(); ++iter)
+    {
+        // An invalid value removes a property the state created
+        view->setProperty(iter.key().toUtf8().constData(), iter.value());
+    }
+    return image;
+}
+
+void AppHeadlessWindow::waitUntilLoaded(const QString &viewName)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QQuickItem* view = getView(viewName);
+    while (timer.elapsed() < m_loadTimeout)
+    {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+        QQmlIncubationController* controller = engine()->incubationController();
+        bool incubating = controller && controller->incubatingObjectCount() > 0;
+        if (incubating)
+        {
+            controller->incubateFor(5);
+            continue;
+        }
+        if (!isViewLoading(viewName) && !hasLoadingImages(view))
+        {
+            return;
+        }
+    }
+    appCWarning(lcAppCapture, viewName) << Q_FUNC_INFO << ": The view "+viewName+" did not finish loading in time";
+}
@@ -0,0 +1,136 @@
+#ifndef APPHEADLESSWINDOW_HH
+#define APPHEADLESSWINDOW_HH
+
+#include "appwindow.hh"
+#include <QQmlIncubationController>
+#include <QImage>
+#include <QVariantMap>
+#include <QElapsedTimer>
+class QQuickRenderControl;
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppHeadlessWindow is an AppWindow that is never shown. It renders
+/// through a QQuickRenderControl with the software scene graph backend, so it
+/// runs without a display or GPU, e.g. with the "offscreen" platform plugin:
+///     QT_QPA_PLATFORM=offscreen ./renderer
+/// Views, layers and AppObjectHandlers are used the same way as with a shown
+/// window. Render jobs of a view and the property values to set on it are
+/// queued with enqueue() and rendered back to back with renderAll(), reusing
+/// the loaded views and compiled components between the jobs.
+///
+/// The software backend is selected for the process when the first headless
+/// window is created, unless another backend has been selected before.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppHeadlessWindow : public AppWindow
+{
+    Q_OBJECT
+
+public:
+    /** Statistics of the rendered jobs. */
+    struct Stats
+    {
+        int renders;
+        qint64 totalRenderNsec;     ///< Time spent preparing and rendering the jobs
+        qint64 totalLatencyNsec;    ///< Time from enqueue() to the rendered image
+        qint64 maxLatencyNsec;
+        qreal rendersPerSecond;     ///< Throughput of the last renderAll()
+    };
+
+    /***************************************************************************
+     * CONSTRUCTOR AND DESTRUCTOR
+     */
+    /**
+     * @param rootFolderPath The path of to the root folder containing the main
+     * QML-file.
+     * @param mainQML The main view, which holds the layers
+     * @param size The size of the rendered images
+     */
+    AppHeadlessWindow(const QString& rootFolderPath,
+                      const QString& mainQML,
+                      const QSize& size);
+
+    virtual ~AppHeadlessWindow();
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    /**
+     * Queues a render job. The view is loaded if needed, shown as the only
+     * view over the main view, and the state is set as its properties for
+     * this job only.
+     * @return The id of the job, passed to jobRendered()
+     */
+    int enqueue(const QString& viewName, const QVariantMap& state=QVariantMap());
+
+    /** Returns the number of queued jobs. */
+    int getPendingJobs() const {return m_jobs.size();}
+
+    /** Renders all the queued jobs, emitting jobRendered() for each. */
+    void renderAll();
+
+    /** Renders the view with the state at once, bypassing the queue. */
+    QImage render(const QString& viewName, const QVariantMap& state=QVariantMap());
+
+    /** Sets how long a job waits for its sections and images to load. */
+    void setLoadTimeout(int msec);
+
+    Stats stats() const {return m_stats;}
+    void resetStats();
+
+signals:
+    /***************************************************************************
+     * SIGNALS
+     */
+    void jobRendered(int jobId, const QImage& image, qint64 latencyNsec);
+    void queueFinished();
+
+private:
+    /** A queued render job. */
+    struct Job
+    {
+        int id;
+        QString viewName;
+        QVariantMap state;
+        qint64 queuedAt;    ///< Nanoseconds on m_clock
+    };
+
+    /***************************************************************************
+     * PRIVATE FUNCTIONS
+     */
+    AppHeadlessWindow(QQuickRenderControl* renderControl,
+                      const QString& rootFolderPath,
+                      const QString& mainQML,
+                      const QSize& size);
+
+    /** Selects the software backend and creates the render control. */
+    static QQuickRenderControl* createRenderControl();
+
+    /** Renders the job and adds it to the stats.
+     * @param latency Set to the time from enqueue() to the rendered image
+     */
+    QImage renderJob(const Job& job, qint64& latency);
+
+    /** Prepares the view for the job and renders it. */
+    QImage grabJob(const Job& job);
+
+    /** Runs the incubation and events until the view and its images are
+     * loaded or the timeout is reached. */
+    void waitUntilLoaded(const QString& viewName);
+
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    QQuickRenderControl* m_renderControl;
+    QString m_mainView;                                 ///< Stays shown under the rendered views
+    QQmlIncubationController m_incubationController;    ///< Driven while waiting, as there are no frames
+    QList<Job> m_jobs;
+    int m_nextJobId;
+    int m_loadTimeout;
+    QElapsedTimer m_clock;
+    Stats m_stats;
+};
+
+#endif // APPHEADLESSWINDOW_HH
@@ -0,0 +1,318 @@
+#include "appimageprovider.hh"
+#include "appresourceprovider.hh"
+#include "applogging.hh"
+#include <QImageReader>
+#include <QElapsedTimer>
+#include <QRunnable>
+#include <QAtomicInt>
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The response to one image request, decoded on the thread pool of the
+/// provider unless the image is already cached.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppImageResponse : public QQuickImageResponse, public QRunnable
+{
+public:
+    AppImageResponse(AppImageProvider* provider,
+                     const QString& id,
+                     const QSize& requestedSize)
+        : m_provider(provider)
+        , m_id(id)
+        , m_requestedSize(requestedSize)
+    {
+        // Deleted by the engine after finished()
+        setAutoDelete(false);
+    }
+
+    /** Finishes the response with an image found in the cache. */
+    void finishWith(const QImage& image)
+    {
+        m_image = image;
+        // Queued, as the engine connects to finished() after the request
+        QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+    }
+
+    virtual QQuickTextureFactory* textureFactory() const
+    {
+        return QQuickTextureFactory::textureFactoryForImage(m_image);
+    }
+
+    virtual QString errorString() const
+    {
+        return m_errorString;
+    }
+
+    virtual void cancel()
+    {
+        m_cancelled.store(1);
+    }
+
+    virtual void run()
+    {
+        if (!m_cancelled.load())
+        {
+            m_image = m_provider->image(m_id, m_requestedSize, &m_errorString);
+        }
+        emit finished();
+    }
+
+private:
+    AppImageProvider* m_provider;
+    QString m_id;
+    QSize m_requestedSize;
+    QImage m_image;
+    QString m_errorString;
+    QAtomicInt m_cancelled;
+};
+
+/** Decodes an image into the cache of the provider. */
+class AppImagePrefetch : public QRunnable
+{
+public:
+    AppImagePrefetch(AppImageProvider* provider, const QString& id)
+        : m_provider(provider)
+        , m_id(id)
+    {
+    }
+
+    virtual void run()
+    {
+        m_provider->image(m_id, QSize());
+    }
+
+private:
+    AppImageProvider* m_provider;
+    QString m_id;
+};
+
+/*******************************************************************************
+ * CONSTRUCTOR AND DESTRUCTOR
+ */
+AppImageProvider::AppImageProvider(const QString &rootFolderPath)
+    : QQuickAsyncImageProvider()
+    , m_rootFolderPath(rootFolderPath)
+    , m_cacheBudget(64*1024*1024)
+    , m_useCount(0)
+{
+    m_stats.hits = 0;
+    m_stats.misses = 0;
+    m_stats.decodes = 0;
+    m_stats.decodeNsec = 0;
+    m_stats.cachedBytes = 0;
+    m_stats.cachedImages = 0;
+}
+
+AppImageProvider::~AppImageProvider()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ */
+qreal AppImageProvider::Stats::hitRate() const
+{
+    return hits+misses > 0 ? qreal(hits)/(hits+misses) : 0;
+}
+
+qint64 AppImageProvider::Stats::averageDecodeNsec() const
+{
+    return decodes > 0 ? decodeNsec/qint64(decodes) : 0;
+}
+
+QQuickImageResponse* AppImageProvider::requestImageResponse(const QString &id,
+                                                            const QSize &requestedSize)
+{
+    AppImageResponse* response = new AppImageResponse(this, id, requestedSize);
+    QImage image;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (lookup(cacheKey(id, requestedSize), &image))
+        {
+            ++m_stats.hits;
+        }
+    }
+    if (!image.isNull())
+    {
+        response->finishWith(image);
+    }
+    else
+    {
+        m_pool.start(response);
+    }
+    return response;
+}
+
+void AppImageProvider::prefetch(const QStringList &ids)
+{
+    for (auto iter = ids.constBegin(); iter != ids.constEnd(); ++iter)
+    {
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_cache.contains(cacheKey(*iter, QSize())))
+            {
+                continue;
+            }
+        }
+        m_pool.start(new AppImagePrefetch(this, *iter));
+    }
+}
+
+void AppImageProvider::setCacheBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cacheBudget = bytes;
+    evict(m_cacheBudget);
+}
+
+qint64 AppImageProvider::getCacheBudget() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_cacheBudget;
+}
+
+void AppImageProvider::trimCache(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    evict(bytes);
+}
+
+void AppImageProvider::setMaxThreadCount(int count)
+{
+    m_pool.setMaxThreadCount(count);
+}
+
+AppImageProvider::Stats AppImageProvider::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_stats;
+}
+
+QImage AppImageProvider::image(const QString &id, const QSize &requestedSize,
+                               QString *errorString)
+{
+    QString key = cacheKey(id, requestedSize);
+    QImage image;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (lookup(key, &image))
+        {
+            ++m_stats.hits;
+            return image;
+        }
+        ++m_stats.misses;
+    }
+    // Decoded without the lock; a concurrent decode of the same image only
+    // costs time, the later one replaces the earlier in the cache
+    QElapsedTimer timer;
+    timer.start();
+    QString error;
+    image = decode(id, requestedSize, &error);
+    qint64 elapsed = timer.nsecsElapsed();
+    QMutexLocker locker(&m_mutex);
+    ++m_stats.decodes;
+    m_stats.decodeNsec += elapsed;
+    if (image.isNull())
+    {
+        if (errorString)
+        {
+            *errorString = error;
+        }
+        return image;
+    }
+    insert(key, image);
+    return image;
+}
+
+/*******************************************************************************
+ * PRIVATE FUNCTIONS
+ */
+QString AppImageProvider::cacheKey(const QString &id, const QSize &requestedSize)
+{
+    if (!requestedSize.isValid())
+    {
+        return id;
+    }
+    return id+"@"+QString::number(requestedSize.width())+"x"
+            +QString::number(requestedSize.height());
+}
+
+bool AppImageProvider::lookup(const QString &key, QImage *image)
+{
+    auto iter = m_cache.find(key);
+    if (iter == m_cache.end())
+    {
+        return false;
+    }
+    m_lru.remove(iter->lastUse);
+    iter->lastUse = ++m_useCount;
+    m_lru.insert(iter->lastUse, key);
+    *image = iter->image;
+    return true;
+}
+
+void AppImageProvider::insert(const QString &key, const QImage &image)
+{
+    auto iter = m_cache.find(key);
+    if (iter != m_cache.end())
+    {
+        m_stats.cachedBytes -= iter->image.sizeInBytes();
+        m_lru.remove(iter->lastUse);
+        m_cache.erase(iter);
+    }
+    // An image larger than the whole budget is returned but not cached
+    if (image.sizeInBytes() > m_cacheBudget)
+    {
+        m_stats.cachedImages = m_cache.size();
+        return;
+    }
+    evict(m_cacheBudget-image.sizeInBytes());
+    Entry entry;
+    entry.image = image;
+    entry.lastUse = ++m_useCount;
+    m_lru.insert(entry.lastUse, key);
+    m_cache.insert(key, entry);
+    m_stats.cachedBytes += image.sizeInBytes();
+    m_stats.cachedImages = m_cache.size();
+}
+
+void AppImageProvider::evict(qint64 bytes)
+{
+    while (m_stats.cachedBytes > bytes && !m_lru.isEmpty())
+    {
+        auto iter = m_cache.find(m_lru.take(m_lru.firstKey()));
+        m_stats.cachedBytes -= iter->image.sizeInBytes();
+        m_cache.erase(iter);
+    }
+    m_stats.cachedImages = m_cache.size();
+}
+
+QImage AppImageProvider::decode(const QString &id, const QSize &requestedSize,
+                                QString *errorString) const
+{
+    QString path = m_rootFolderPath+id;
+    QImageReader reader(AppResourceProvider::forPath(path)->path(path));
+    if (requestedSize.isValid())
+    {
+        // Decoding straight to the requested size saves memory and time
+        QSize size = reader.size();
+        if (size.isValid())
+        {
+            size.scale(requestedSize.width() > 0 ? requestedSize.width() : size.width(),
+                       requestedSize.height() > 0 ? requestedSize.height() : size.height(),
+                       Qt::KeepAspectRatio);
+            reader.setScaledSize(size);
+        }
+    }
+    QImage image = reader.read();
+    if (image.isNull())
+    {
+        *errorString = reader.errorString();
+        appCWarning(lcAppResources, id) << Q_FUNC_INFO << ": Cannot decode the image "+id+": "+*errorString;
+    }
+    return image;
+}
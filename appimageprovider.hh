@@ -0,0 +1,128 @@
+#ifndef APPIMAGEPROVIDER_HH
+#define APPIMAGEPROVIDER_HH
+
+#include <QQuickAsyncImageProvider>
+#include <QThreadPool>
+#include <QMutex>
+#include <QHash>
+#include <QMap>
+#include <QImage>
+#include <QStringList>
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppImageProvider decodes the images of the app on a thread pool, so
+/// that loading a view never waits for image decoding on the GUI thread. The
+/// decoded images are kept in an LRU cache shared by all the views and
+/// components of the engine and bounded by a byte budget.
+///
+/// The AppWindow registers the provider on its engine with the name "app",
+/// so an image is used in QML with a path relative to the root folder:
+///     Image { source: "image://app/images/background.png" }
+/// The paths are resolved by the AppResourceProvider of the root folder.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppImageProvider : public QQuickAsyncImageProvider
+{
+public:
+    /** Statistics of the cache and the decoding. */
+    struct Stats
+    {
+        quint64 hits;           ///< Requests served from the cache, prefetches included
+        quint64 misses;         ///< Requests that needed decoding, prefetches included
+        quint64 decodes;        ///< Images decoded, including prefetched ones
+        qint64 decodeNsec;      ///< Total time spent decoding
+        qint64 cachedBytes;
+        int cachedImages;
+
+        qreal hitRate() const;
+        qint64 averageDecodeNsec() const;
+    };
+
+    /***************************************************************************
+     * CONSTRUCTOR AND DESTRUCTOR
+     */
+    /**
+     * @param rootFolderPath The root folder the image paths are relative to
+     */
+    explicit AppImageProvider(const QString& rootFolderPath);
+
+    /** Waits for the running decodes. */
+    virtual ~AppImageProvider();
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    virtual QQuickImageResponse* requestImageResponse(const QString& id,
+                                                      const QSize& requestedSize);
+
+    /**
+     * Decodes the images into the cache in the background, e.g. for the
+     * next view before it is loaded.
+     * @param ids The image paths as used after "image://app/"
+     */
+    void prefetch(const QStringList& ids);
+
+    /** Sets the byte budget of the cache, evicting images if needed. */
+    void setCacheBudget(qint64 bytes);
+    qint64 getCacheBudget() const;
+
+    /** Evicts the least recently used images until at most the given number
+     * of bytes are cached. */
+    void trimCache(qint64 bytes=0);
+
+    /** Sets the number of decoding threads. */
+    void setMaxThreadCount(int count);
+
+    Stats stats() const;
+
+    /**
+     * Returns the decoded image, from the cache or decoding it on the
+     * calling thread. Thread-safe.
+     * @param errorString Set if the image cannot be decoded
+     */
+    QImage image(const QString& id, const QSize& requestedSize,
+                 QString* errorString=0);
+
+private:
+    /** A decoded image in the cache. */
+    struct Entry
+    {
+        QImage image;
+        quint64 lastUse;                ///< Key of the entry in m_lru
+    };
+
+    /***************************************************************************
+     * PRIVATE FUNCTIONS
+     */
+    /** Returns the cache key of the request. */
+    static QString cacheKey(const QString& id, const QSize& requestedSize);
+
+    /** Looks up the image and marks it used. Call with m_mutex locked. */
+    bool lookup(const QString& key, QImage* image);
+
+    /** Adds the image to the cache. Call with m_mutex locked. */
+    void insert(const QString& key, const QImage& image);
+
+    /** Evicts images until the cache fits the bytes. Call with m_mutex locked. */
+    void evict(qint64 bytes);
+
+    /** Decodes the image file. */
+    QImage decode(const QString& id, const QSize& requestedSize,
+                  QString* errorString) const;
+
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    QString m_rootFolderPath;
+    QThreadPool m_pool;
+    mutable QMutex m_mutex;             ///< Guards the cache and the statistics
+    QHash<QString, Entry> m_cache;
+    QMap<quint64, QString> m_lru;       ///< Cache keys by last use, least recently used first
+    quint64 m_useCount;                 ///< Source of the last use stamps
+    qint64 m_cacheBudget;
+    Stats m_stats;
+};
+
+#endif // APPIMAGEPROVIDER_HH
@@ -0,0 +1,34 @@
+#include "appitemincubator.hh"
+
+/*******************************************************************************
+ * CONSTRUCTOR AND DESTRUCTOR
+ */
+AppItemIncubator::AppItemIncubator(const QVariantMap& initialProperties,
+                                   QQuickItem* parentItem,
+                                   IncubationMode mode)
+    : QQmlIncubator(mode)
+    , m_initialProperties(initialProperties)
+    , m_parentItem(parentItem)
+{
+}
+
+AppItemIncubator::~AppItemIncubator()
+{
+}
+
+/*******************************************************************************
+ * PROTECTED FUNCTIONS
+ */
+void AppItemIncubator::setInitialState(QObject* object)
+{
+    QQuickItem* item = qobject_cast<QQuickItem*>(object);
+    if (item && m_parentItem)
+    {
+        item->setParent(m_parentItem.data());
+        item->setParentItem(m_parentItem.data());
+    }
+    for (auto iter = m_initialProperties.constBegin(); iter != m_initialProperties.constEnd(); ++iter)
+    {
+        object->setProperty(iter.key().toUtf8().constData(), iter.value());
+    }
+}
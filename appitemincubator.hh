@@ -0,0 +1,50 @@
+#ifndef APPITEMINCUBATOR_HH
+#define APPITEMINCUBATOR_HH
+
+#include <QQmlIncubator>
+#include <QQuickItem>
+#include <QVariantMap>
+#include <QPointer>
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppItemIncubator applies the visual parent and initial property values
+/// of an incubated object before its bindings are evaluated and before
+/// componentComplete() is called. The created item is therefore born in its
+/// final state, and no property change handlers or layouts are re-run for it.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppItemIncubator : public QQmlIncubator
+{
+public:
+    /***************************************************************************
+     * CONSTRUCTOR AND DESTRUCTOR
+     */
+    /**
+     * @param initialProperties The property values the object is created with
+     * @param parentItem The possible visual parent (and owner) of the object
+     * @param mode The incubation mode
+     */
+    AppItemIncubator(const QVariantMap& initialProperties=QVariantMap(),
+                     QQuickItem* parentItem=0,
+                     IncubationMode mode=AsynchronousIfNested);
+
+    virtual ~AppItemIncubator();
+
+protected:
+    /***************************************************************************
+     * PROTECTED FUNCTIONS
+     */
+    /** Sets the parent and the initial properties of the created object. */
+    virtual void setInitialState(QObject* object);
+
+private:
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    QVariantMap m_initialProperties;    ///< Property values applied before completion
+    QPointer<QQuickItem> m_parentItem;  ///< The visual parent of the created item
+};
+
+#endif // APPITEMINCUBATOR_HH
@@ -0,0 +1,425 @@
+#include "appjobsystem.hh"
+#include "applogging.hh"
+#include <QQmlEngine>
+
+namespace
+{
+thread_local AppJob* currentJob = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// A worker thread and its queue of jobs.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppJobSystem::Worker : public QThread
+{
+public:
+    Worker(AppJobSystem* system, int index)
+        : m_system(system)
+        , m_index(index)
+    {
+    }
+
+    QMutex mutex;               ///< Guards the queue
+    std::deque<AppJob*> queue;  ///< Own jobs are taken from the back, stolen from the front
+
+protected:
+    virtual void run()
+    {
+        m_system->workerLoop(m_index);
+    }
+
+private:
+    AppJobSystem* m_system;
+    int m_index;
+};
+
+/*******************************************************************************
+ * AppJob
+ */
+AppJob::AppJob(AppJobSystem *system, const Work &work, const QString &taskName)
+    : QObject(system)
+    , m_system(system)
+    , m_work(work)
+    , m_taskName(taskName)
+    , m_state(Waiting)
+    , m_waitingFor(0)
+    , m_passResult(false)
+    , m_delivered(false)
+    , m_autoDelete(true)
+    , m_queuedAt(0)
+    , m_startedAt(0)
+    , m_runNsec(0)
+{
+}
+
+AppJob::State AppJob::getState() const
+{
+    QMutexLocker locker(&m_system->m_graphMutex);
+    return m_state;
+}
+
+QVariant AppJob::getResult() const
+{
+    // Read only after the delivery, when the workers are done with it
+    return m_delivered ? m_result : QVariant();
+}
+
+qreal AppJob::getRunTime() const
+{
+    return m_delivered ? m_runNsec/1000000.0 : 0;
+}
+
+qreal AppJob::getQueueTime() const
+{
+    return m_delivered && m_startedAt > 0 ? (m_startedAt-m_queuedAt)/1000000.0 : 0;
+}
+
+AppJob* AppJob::continueWith(const Work &work)
+{
+    QList<AppJob*> dependencies;
+    dependencies.append(this);
+    return m_system->createJob(work, QVariant(), dependencies, QString(), true);
+}
+
+AppJob* AppJob::then(const QJSValue &callback, const QJSValue &onCancelled)
+{
+    if (!callback.isCallable() || !(onCancelled.isUndefined() || onCancelled.isCallable()))
+    {
+        appCWarning(lcAppJobs, QString()) << Q_FUNC_INFO << ": The callback is not a function";
+        return this;
+    }
+    if (m_delivered)
+    {
+        if (m_state != Cancelled)
+        {
+            QJSValue(callback).call(QJSValueList() << m_system->m_engine->toScriptValue(m_result));
+        }
+        else if (onCancelled.isCallable())
+        {
+            QJSValue(onCancelled).call();
+        }
+    }
+    else
+    {
+        m_callbacks.append(callback);
+        if (onCancelled.isCallable())
+        {
+            m_cancelCallbacks.append(onCancelled);
+        }
+    }
+    return this;
+}
+
+void AppJob::cancel()
+{
+    m_system->cancel(this);
+}
+
+AppJob* AppJob::current()
+{
+    return currentJob;
+}
+
+void AppJob::deliver()
+{
+    m_delivered = true;
+    emit stateChanged();
+    if (m_state == Cancelled)
+    {
+        emit cancelled();
+        for (auto iter = m_cancelCallbacks.begin(); iter != m_cancelCallbacks.end(); ++iter)
+        {
+            iter->call();
+        }
+    }
+    else
+    {
+        emit finished(m_result);
+        QJSValue result = m_system->m_engine->toScriptValue(m_result);
+        for (auto iter = m_callbacks.begin(); iter != m_callbacks.end(); ++iter)
+        {
+            iter->call(QJSValueList() << result);
+        }
+    }
+    m_callbacks.clear();
+    m_cancelCallbacks.clear();
+    if (m_autoDelete)
+    {
+        deleteLater();
+    }
+}
+
+/*******************************************************************************
+ * CONSTRUCTOR AND DESTRUCTOR
+ */
+AppJobSystem::AppJobSystem(QQmlEngine *engine, QObject *parent, int threadCount)
+    : QObject(parent)
+    , m_engine(engine)
+{
+    m_clock.start();
+    if (threadCount <= 0)
+    {
+        threadCount = qMax(1, QThread::idealThreadCount()-1);
+    }
+    for (int i = 0; i < threadCount; ++i)
+    {
+        m_workers.append(new Worker(this, i));
+    }
+    for (auto iter = m_workers.constBegin(); iter != m_workers.constEnd(); ++iter)
+    {
+        (*iter)->start();
+    }
+}
+
+AppJobSystem::~AppJobSystem()
+{
+    m_stopping.store(1);
+    {
+        QMutexLocker locker(&m_sleepMutex);
+        m_wake.wakeAll();
+    }
+    for (auto iter = m_workers.constBegin(); iter != m_workers.constEnd(); ++iter)
+    {
+        (*iter)->wait();
+    }
+    qDeleteAll(m_workers);
+    // The jobs are children of this object and deleted with it
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ */
+AppJob* AppJobSystem::run(const AppJob::Work &work,
+                          const QVariant &input,
+                          const QList<AppJob*> &dependencies)
+{
+    return createJob(work, input, dependencies, QString(), false);
+}
+
+void AppJobSystem::registerTask(const QString &name, const AppJob::Work &work)
+{
+    m_tasks.insert(name, work);
+}
+
+AppJob* AppJobSystem::run(const QString &taskName, const QVariant &arguments)
+{
+    auto iter = m_tasks.constFind(taskName);
+    if (iter == m_tasks.constEnd())
+    {
+        appCWarning(lcAppJobs, taskName) << Q_FUNC_INFO << ": Unknown task "+taskName;
+        return 0;
+    }
+    AppJob* job = createJob(*iter, arguments, QList<AppJob*>(), taskName, false);
+    // The job belongs to this system, not to the JavaScript garbage collector
+    QQmlEngine::setObjectOwnership(job, QQmlEngine::CppOwnership);
+    return job;
+}
+
+bool AppJobSystem::hasTask(const QString &taskName) const
+{
+    return m_tasks.contains(taskName);
+}
+
+AppJobSystem::TaskStats AppJobSystem::taskStats(const QString &taskName) const
+{
+    QMutexLocker locker(&m_statsMutex);
+    TaskStats empty = {0, 0, 0, 0};
+    return m_taskStats.value(taskName, empty);
+}
+
+/*******************************************************************************
+ * PRIVATE FUNCTIONS
+ */
+AppJob* AppJobSystem::createJob(const AppJob::Work &work, const QVariant &input,
+                                const QList<AppJob*> &dependencies,
+                                const QString &taskName, bool passResult)
+{
+    AppJob* job = new AppJob(this, work, taskName);
+    job->m_passResult = passResult;
+    job->m_queuedAt = m_clock.nsecsElapsed();
+    bool cancelled = false;
+    {
+        QMutexLocker locker(&m_graphMutex);
+        if (dependencies.isEmpty())
+        {
+            job->m_input = input;
+        }
+        else
+        {
+            QVariantList inputs;
+            for (int i = 0; i < dependencies.size(); ++i)
+            {
+                AppJob* dependency = dependencies[i];
+                // A result is only complete once the job is finished, the
+                // slot of an unfinished one is filled in by finish()
+                inputs.append(dependency->m_state == AppJob::Finished ? dependency->m_result : QVariant());
+                if (dependency->m_state == AppJob::Cancelled)
+                {
+                    cancelled = true;
+                }
+                else if (dependency->m_state != AppJob::Finished)
+                {
+                    dependency->m_dependents.append(qMakePair(job, i));
+                    ++job->m_waitingFor;
+                }
+            }
+            job->m_input = passResult ? inputs.first() : QVariant(inputs);
+        }
+        if (cancelled)
+        {
+            job->m_cancelled.store(1);
+        }
+        if (job->m_waitingFor > 0)
+        {
+            return job;
+        }
+        job->m_state = AppJob::Queued;
+    }
+    enqueue(job, -1);
+    return job;
+}
+
+void AppJobSystem::enqueue(AppJob *job, int workerIndex)
+{
+    if (workerIndex < 0)
+    {
+        workerIndex = (m_nextWorker.fetchAndAddRelaxed(1) & 0x7fffffff) % m_workers.size();
+    }
+    Worker* worker = m_workers[workerIndex];
+    {
+        QMutexLocker locker(&worker->mutex);
+        worker->queue.push_back(job);
+    }
+    m_queued.ref();
+    QMutexLocker locker(&m_sleepMutex);
+    m_wake.wakeOne();
+}
+
+void AppJobSystem::workerLoop(int workerIndex)
+{
+    while (!m_stopping.load())
+    {
+        AppJob* job = take(workerIndex);
+        if (job)
+        {
+            execute(job, workerIndex);
+            continue;
+        }
+        QMutexLocker locker(&m_sleepMutex);
+        if (m_queued.load() == 0 && !m_stopping.load())
+        {
+            m_wake.wait(&m_sleepMutex);
+        }
+    }
+}
+
+AppJob* AppJobSystem::take(int workerIndex)
+{
+    Worker* own = m_workers[workerIndex];
+    {
+        QMutexLocker locker(&own->mutex);
+        if (!own->queue.empty())
+        {
+            AppJob* job = own->queue.back();
+            own->queue.pop_back();
+            m_queued.deref();
+            return job;
+        }
+    }
+    for (int i = 1; i < m_workers.size(); ++i)
+    {
+        Worker* victim = m_workers[(workerIndex+i) % m_workers.size()];
+        QMutexLocker locker(&victim->mutex);
+        if (!victim->queue.empty())
+        {
+            AppJob* job = victim->queue.front();
+            victim->queue.pop_front();
+            m_queued.deref();
+            m_stolen.ref();
+            return job;
+        }
+    }
+    return 0;
+}
+
+void AppJobSystem::execute(AppJob *job, int workerIndex)
+{
+    if (!job->isCancelled())
+    {
+        {
+            QMutexLocker locker(&m_graphMutex);
+            job->m_state = AppJob::Running;
+        }
+        job->m_startedAt = m_clock.nsecsElapsed();
+        currentJob = job;
+        job->m_result = job->m_work(job->m_input);
+        currentJob = 0;
+        job->m_runNsec = m_clock.nsecsElapsed()-job->m_startedAt;
+    }
+    finish(job, workerIndex);
+}
+
+void AppJobSystem::finish(AppJob *job, int workerIndex)
+{
+    QList<AppJob*> ready;
+    bool cancelled = job->isCancelled();
+    {
+        QMutexLocker locker(&m_graphMutex);
+        job->m_state = cancelled ? AppJob::Cancelled : AppJob::Finished;
+        for (auto iter = job->m_dependents.constBegin(); iter != job->m_dependents.constEnd(); ++iter)
+        {
+            AppJob* dependent = iter->first;
+            if (cancelled)
+            {
+                dependent->m_cancelled.store(1);
+            }
+            else if (dependent->m_passResult)
+            {
+                dependent->m_input = job->m_result;
+            }
+            else
+            {
+                QVariantList inputs = dependent->m_input.toList();
+                inputs[iter->second] = job->m_result;
+                dependent->m_input = inputs;
+            }
+            if (--dependent->m_waitingFor == 0)
+            {
+                dependent->m_state = AppJob::Queued;
+                ready.append(dependent);
+            }
+        }
+        job->m_dependents.clear();
+    }
+    if (!job->m_taskName.isEmpty())
+    {
+        QMutexLocker locker(&m_statsMutex);
+        TaskStats& stats = m_taskStats[job->m_taskName];
+        if (cancelled)
+        {
+            ++stats.cancelled;
+        }
+        else
+        {
+            ++stats.runs;
+            stats.totalNsec += job->m_runNsec;
+            stats.maxNsec = qMax(stats.maxNsec, job->m_runNsec);
+        }
+    }
+    // The released jobs continue on this worker, while its caches are warm
+    for (auto iter = ready.constBegin(); iter != ready.constEnd(); ++iter)
+    {
+        enqueue(*iter, workerIndex);
+    }
+    QMetaObject::invokeMethod(job, "deliver", Qt::QueuedConnection);
+}
+
+void AppJobSystem::cancel(AppJob *job)
+{
+    // A queued job is finished without running when it is taken, and a
+    // waiting one when its dependencies are done, as they still refer to it
+    job->m_cancelled.store(1);
+}
@@ -0,0 +1,263 @@
+#ifndef APPJOBSYSTEM_HH
+#define APPJOBSYSTEM_HH
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QVariant>
+#include <QJSValue>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <deque>
+#include <functional>
+class QQmlEngine;
+class AppJobSystem;
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppJob is a unit of work run by the AppJobSystem, and the promise-like
+/// handle to its result. The work is run on a worker thread once all the jobs
+/// it depends on have finished; the result is delivered on the GUI thread
+/// with finished() and to the callbacks given to then(). A cancelled job
+/// emits cancelled() and calls the onCancelled callbacks of then() instead.
+/// A job deletes itself after the delivery unless setAutoDelete(false) is
+/// called.
+///
+/// In QML:
+///     app.jobs.run("findPath", {from: a, to: b}).then(function(path) {...})
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppJob : public QObject
+{
+    Q_OBJECT
+    friend class AppJobSystem;
+
+public:
+    /** The work of a job. Gets the input of the job and returns the result. */
+    typedef std::function<QVariant(const QVariant&)> Work;
+
+    enum State
+    {
+        Waiting,    ///< Waiting for the jobs it depends on
+        Queued,
+        Running,
+        Finished,
+        Cancelled
+    };
+    Q_ENUM(State)
+
+    /***************************************************************************
+     * PROPERTIES
+     */
+    Q_PROPERTY (State state READ getState NOTIFY stateChanged)
+        State getState() const;
+    Q_PROPERTY (QVariant result READ getResult NOTIFY finished)
+        QVariant getResult() const;
+    Q_PROPERTY (qreal runTime READ getRunTime NOTIFY finished)
+        /** Returns the milliseconds the work ran. */
+        qreal getRunTime() const;
+    Q_PROPERTY (qreal queueTime READ getQueueTime NOTIFY finished)
+        /** Returns the milliseconds from queuing to running. */
+        qreal getQueueTime() const;
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    /** Returns the name of the registered task, empty for other jobs. */
+    QString getTaskName() const {return m_taskName;}
+
+    /**
+     * Runs the work with the result of this job once it has finished. If
+     * this job is cancelled, the continuation is cancelled too.
+     * @return The job of the continuation
+     */
+    AppJob* continueWith(const Work& work);
+
+    /** Calls the callback on the GUI thread with the result of this job, or
+     * onCancelled without arguments if the job is cancelled. Called at once
+     * if the job has already been delivered.
+     * @return This job, for chaining
+     */
+    Q_INVOKABLE AppJob* then(const QJSValue& callback, const QJSValue& onCancelled=QJSValue());
+
+    /** Cancels the job if it has not started yet, and the jobs that depend on
+     * it. Running work can check isCancelled() to stop early. A cancelled job
+     * that waits for other jobs is delivered when they are done. */
+    Q_INVOKABLE void cancel();
+
+    /** Thread-safe. */
+    bool isCancelled() const {return m_cancelled.load() != 0;}
+
+    /** Sets whether the job deletes itself after delivering its result. */
+    void setAutoDelete(bool autoDelete) {m_autoDelete = autoDelete;}
+
+    /** Returns the job being run on the calling worker thread, or null. */
+    static AppJob* current();
+
+signals:
+    /***************************************************************************
+     * SIGNALS
+     */
+    void stateChanged();
+    void finished(const QVariant& result);
+    void cancelled();
+
+private slots:
+    /***************************************************************************
+     * PRIVATE SLOTS
+     */
+    /** Emits the result on the GUI thread. */
+    void deliver();
+
+private:
+    /***************************************************************************
+     * PRIVATE FUNCTIONS
+     */
+    AppJob(AppJobSystem* system, const Work& work, const QString& taskName);
+
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    AppJobSystem* m_system;
+    Work m_work;
+    QString m_taskName;
+    QVariant m_input;           ///< The argument, or the results of the dependencies
+    QVariant m_result;
+    State m_state;              ///< Guarded by the graph mutex of the system
+    QAtomicInt m_cancelled;
+    int m_waitingFor;           ///< Unfinished dependencies, guarded by the graph mutex
+    bool m_passResult;          ///< Continuation of continueWith(), gets the result as such
+    QList<QPair<AppJob*, int> > m_dependents;  ///< Jobs waiting for this one and the index of this one in their input
+    QList<QJSValue> m_callbacks;
+    QList<QJSValue> m_cancelCallbacks;
+    bool m_delivered;
+    bool m_autoDelete;
+    qint64 m_queuedAt;          ///< Nanoseconds on the clock of the system
+    qint64 m_startedAt;
+    qint64 m_runNsec;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppJobSystem runs AppJobs on a pool of worker threads. Each worker has
+/// its own queue, takes the newest job from it, and steals the oldest job
+/// from the other workers when it runs empty, so that jobs spawned by a graph
+/// stay on warm caches while the workers stay busy. Jobs can depend on other
+/// jobs, which makes task graphs, and are delivered back on the GUI thread.
+///
+/// QML can run only tasks registered by name with registerTask(), as
+/// arbitrary JavaScript cannot run outside the GUI thread.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppJobSystem : public QObject
+{
+    Q_OBJECT
+    friend class AppJob;
+
+public:
+    /** Timing of a registered task. */
+    struct TaskStats
+    {
+        int runs;
+        int cancelled;
+        qint64 totalNsec;
+        qint64 maxNsec;
+    };
+
+    /***************************************************************************
+     * CONSTRUCTOR AND DESTRUCTOR
+     */
+    /**
+     * @param engine The engine the QML callbacks are called in
+     * @param threadCount The number of workers, 0 for one less than the cores
+     */
+    explicit AppJobSystem(QQmlEngine* engine, QObject* parent=0, int threadCount=0);
+
+    /** Stops the workers after the running jobs. Queued jobs are dropped. */
+    virtual ~AppJobSystem();
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    /**
+     * Runs the work. Call from the GUI thread.
+     * @param work The work, run on a worker thread
+     * @param input The input of the work
+     * @param dependencies Jobs that must finish first. If there are any, the
+     * input of the work is the list of their results instead.
+     */
+    AppJob* run(const AppJob::Work& work,
+                const QVariant& input=QVariant(),
+                const QList<AppJob*>& dependencies=QList<AppJob*>());
+
+    /** Registers a task that can be run by name, e.g. from QML. */
+    void registerTask(const QString& name, const AppJob::Work& work);
+
+    /** Runs the registered task with the arguments. */
+    Q_INVOKABLE AppJob* run(const QString& taskName, const QVariant& arguments=QVariant());
+
+    /** Returns true if the task has been registered. */
+    Q_INVOKABLE bool hasTask(const QString& taskName) const;
+
+    int getThreadCount() const {return m_workers.size();}
+
+    /** Returns the number of jobs run on a worker other than their own. */
+    int getStolenCount() const {return m_stolen.load();}
+
+    /** Returns the timing of the registered task. */
+    TaskStats taskStats(const QString& taskName) const;
+
+private:
+    class Worker;
+
+    /***************************************************************************
+     * PRIVATE FUNCTIONS
+     */
+    /** Creates a job and links it to its dependencies. */
+    AppJob* createJob(const AppJob::Work& work, const QVariant& input,
+                      const QList<AppJob*>& dependencies, const QString& taskName,
+                      bool passResult);
+
+    /** Queues a job whose dependencies have finished. */
+    void enqueue(AppJob* job, int workerIndex);
+
+    /** Runs jobs on the worker until the system is stopped. */
+    void workerLoop(int workerIndex);
+
+    /** Takes the newest job of the worker, or steals the oldest of another. */
+    AppJob* take(int workerIndex);
+
+    /** Runs the job and finishes it. */
+    void execute(AppJob* job, int workerIndex);
+
+    /** Marks the job done, releases its dependents and queues the delivery. */
+    void finish(AppJob* job, int workerIndex);
+
+    /** Marks the job cancelled; finish() passes it on to the dependents. */
+    void cancel(AppJob* job);
+
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    QQmlEngine* m_engine;
+    QList<Worker*> m_workers;
+    QMutex m_graphMutex;                ///< Guards the states and links of the jobs
+    QMutex m_sleepMutex;
+    QWaitCondition m_wake;
+    QAtomicInt m_queued;                ///< Jobs in the queues of the workers
+    QAtomicInt m_stopping;
+    QAtomicInt m_stolen;
+    QAtomicInt m_nextWorker;            ///< Round robin for jobs queued from outside the workers
+    QElapsedTimer m_clock;
+    QHash<QString, AppJob::Work> m_tasks;
+    mutable QMutex m_statsMutex;
+    QHash<QString, TaskStats> m_taskStats;
+};
+
+#endif // APPJOBSYSTEM_HH
@@ -0,0 +1,113 @@
+#include "applogging.hh"
+#include <QDebug>
+
+Q_LOGGING_CATEGORY(lcAppViews, "app.views")
+Q_LOGGING_CATEGORY(lcAppComponents, "app.components")
+Q_LOGGING_CATEGORY(lcAppObjects, "app.objects")
+Q_LOGGING_CATEGORY(lcAppLayers, "app.layers")
+Q_LOGGING_CATEGORY(lcAppResources, "app.resources")
+Q_LOGGING_CATEGORY(lcAppJobs, "app.jobs")
+Q_LOGGING_CATEGORY(lcAppCapture, "app.capture")
+
+namespace
+{
+/** Bound on the seen warnings, which are forgotten when it is reached. */
+const int MAX_SEEN = 4096;
+}
+
+QMutex AppLogging::s_mutex;
+QElapsedTimer AppLogging::s_clock;
+QHash<QPair<const char*, QString>, AppLogging::Seen> AppLogging::s_seen;
+AppLogging::Stats AppLogging::s_stats = {0, 0, 0, 0};
+int AppLogging::s_repeatInterval = 10000;
+int AppLogging::s_rateLimit = 20;
+qint64 AppLogging::s_windowStart = 0;
+int AppLogging::s_windowCount = 0;
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ */
+bool AppLogging::admit(const QLoggingCategory& category, const char* site, const QString& subject)
+{
+    QMutexLocker locker(&s_mutex);
+    if (!s_clock.isValid())
+    {
+        s_clock.start();
+    }
+    qint64 now = s_clock.elapsed();
+
+    // The site is a literal, so its address identifies the line
+    QPair<const char*, QString> key(site, subject);
+    auto iter = s_seen.find(key);
+    if (iter != s_seen.end() && now-iter->shownAt < s_repeatInterval)
+    {
+        ++iter->repeats;
+        ++s_stats.repeats;
+        return false;
+    }
+
+    if (now-s_windowStart >= 1000)
+    {
+        s_windowStart = now;
+        s_windowCount = 0;
+    }
+    if (s_rateLimit > 0 && s_windowCount >= s_rateLimit)
+    {
+        ++s_stats.rateLimited;
+        return false;
+    }
+    ++s_windowCount;
+    ++s_stats.shown;
+
+    quint64 repeats = 0;
+    if (iter == s_seen.end())
+    {
+        if (s_seen.size() >= MAX_SEEN)
+        {
+            s_seen.clear();
+        }
+        Seen seen = {now, 0};
+        s_seen.insert(key, seen);
+        s_stats.distinct = qMax(s_stats.distinct, s_seen.size());
+    }
+    else
+    {
+        repeats = iter->repeats;
+        iter->shownAt = now;
+        iter->repeats = 0;
+    }
+    locker.unlock();
+    if (repeats > 0)
+    {
+        QMessageLogger(0, 0, 0, category.categoryName()).warning()
+                << "The next warning was repeated" << repeats << "times since it was last shown";
+    }
+    return true;
+}
+
+void AppLogging::setRepeatInterval(int msec)
+{
+    QMutexLocker locker(&s_mutex);
+    s_repeatInterval = msec;
+}
+
+void AppLogging::setRateLimit(int warningsPerSecond)
+{
+    QMutexLocker locker(&s_mutex);
+    s_rateLimit = warningsPerSecond;
+}
+
+AppLogging::Stats AppLogging::stats()
+{
+    QMutexLocker locker(&s_mutex);
+    return s_stats;
+}
+
+void AppLogging::reset()
+{
+    QMutexLocker locker(&s_mutex);
+    s_seen.clear();
+    Stats stats = {0, 0, 0, 0};
+    s_stats = stats;
+    s_windowCount = 0;
+}
@@ -0,0 +1,99 @@
+#ifndef APPLOGGING_HH
+#define APPLOGGING_HH
+
+#include <QLoggingCategory>
+#include <QDebug>
+#include <QHash>
+#include <QPair>
+#include <QMutex>
+#include <QElapsedTimer>
+
+Q_DECLARE_LOGGING_CATEGORY(lcAppViews)          ///< "app.views": loading, showing and switching views
+Q_DECLARE_LOGGING_CATEGORY(lcAppComponents)     ///< "app.components": QML components and the registry
+Q_DECLARE_LOGGING_CATEGORY(lcAppObjects)        ///< "app.objects": AppObjects, their items and properties
+Q_DECLARE_LOGGING_CATEGORY(lcAppLayers)         ///< "app.layers": layers looked up by objectName
+Q_DECLARE_LOGGING_CATEGORY(lcAppResources)      ///< "app.resources": resource and image providers
+Q_DECLARE_LOGGING_CATEGORY(lcAppJobs)           ///< "app.jobs": the job system
+Q_DECLARE_LOGGING_CATEGORY(lcAppCapture)        ///< "app.capture": headless rendering, export, recording
+
+/**
+ * Like qCWarning(), but repeats of the same warning are deduplicated and all
+ * the warnings are rate limited by AppLogging. The message is only formatted
+ * when it is shown, so a disabled category or a suppressed repeat costs a
+ * branch and a lookup.
+ * @param category The logging category
+ * @param subject What the warning is about, e.g. the path or property. Repeats
+ * are warnings from the same line with the same subject.
+ */
+#define appCWarning(category, subject) \
+    for (bool app_shown = category().isWarningEnabled() \
+            && AppLogging::admit(category(), __FILE__ ":" QT_STRINGIFY(__LINE__), subject); \
+         app_shown; app_shown = false) \
+        QMessageLogger(QT_MESSAGELOG_FILE, QT_MESSAGELOG_LINE, QT_MESSAGELOG_FUNC, \
+                       category().categoryName()).warning()
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppLogging class decides which of the library's warnings are shown.
+/// A warning of the same line and subject is shown once per repeat
+/// interval, and the number of repeats suppressed in between is reported with
+/// the next one. All the warnings together are limited to a number per second
+/// so that a failure in a loop over thousands of items cannot flood the log in
+/// the middle of frames. The messages are logged through the categories, so
+/// they can be disabled with QLoggingCategory::setFilterRules() or
+/// QT_LOGGING_RULES, e.g. "app.objects.warning=false".
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppLogging
+{
+public:
+    /** Counters of the warnings since the start or reset(). */
+    struct Stats
+    {
+        quint64 shown;          ///< Warnings that were logged
+        quint64 repeats;        ///< Repeats suppressed by the deduplication
+        quint64 rateLimited;    ///< Warnings suppressed by the rate limit
+        int distinct;           ///< Different line and subject pairs seen
+    };
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    /**
+     * Returns true if the warning should be shown, and counts it if not.
+     * Called by appCWarning().
+     */
+    static bool admit(const QLoggingCategory& category, const char* site, const QString& subject);
+
+    /** Sets how often the same warning is shown, in milliseconds. 10 s by default. */
+    static void setRepeatInterval(int msec);
+
+    /** Sets the maximum number of warnings shown per second. 20 by default,
+     * 0 for no limit. */
+    static void setRateLimit(int warningsPerSecond);
+
+    static Stats stats();
+
+    /** Clears the counters and the seen warnings. */
+    static void reset();
+
+private:
+    /** A warning that has been seen. */
+    struct Seen
+    {
+        qint64 shownAt;         ///< Milliseconds on s_clock
+        quint64 repeats;        ///< Suppressed since it was shown
+    };
+
+    static QMutex s_mutex;
+    static QElapsedTimer s_clock;
+    static QHash<QPair<const char*, QString>, Seen> s_seen;
+    static Stats s_stats;
+    static int s_repeatInterval;
+    static int s_rateLimit;
+    static qint64 s_windowStart;            ///< Start of the current second on s_clock
+    static int s_windowCount;               ///< Warnings shown in the current second
+};
+
+#endif // APPLOGGING_HH
@@ -0,0 +1,136 @@
+#include "appmaintenancescheduler.hh"
+#include "appwindow.hh"
+#include "appobjecthandler.hh"
+#include <QQmlEngine>
+#include <QQmlIncubationController>
+
+/*******************************************************************************
+ * CONSTRUCTOR AND DESTRUCTOR
+ */
+AppMaintenanceScheduler::AppMaintenanceScheduler(AppWindow* window)
+    : QObject(window)
+    , m_window(window)
+    , m_idleDelay(1000)
+    , m_handlerCursor(0)
+    , m_lastRenderedFrames(0)
+    , m_passDuration(0)
+    , m_lastPassDuration(0)
+{
+    m_timer.setInterval(250);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(check()));
+}
+
+AppMaintenanceScheduler::~AppMaintenanceScheduler()
+{
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ */
+void AppMaintenanceScheduler::requestMaintenance()
+{
+    if (m_tasks.isEmpty())
+    {
+        m_tasks << CollectGarbage << TrimComponentCache << TrimObjectPools;
+        m_handlerCursor = 0;
+        m_passDuration = 0;
+        m_lastRenderedFrames = m_window->getRenderedFrames();
+        m_timer.start();
+    }
+}
+
+bool AppMaintenanceScheduler::isPending() const
+{
+    return !m_tasks.isEmpty();
+}
+
+void AppMaintenanceScheduler::setIdleDelay(int msec)
+{
+    m_idleDelay = msec;
+}
+
+void AppMaintenanceScheduler::setCheckInterval(int msec)
+{
+    m_timer.setInterval(msec);
+}
+
+qint64 AppMaintenanceScheduler::getLastPassDuration() const
+{
+    return m_lastPassDuration;
+}
+
+/*******************************************************************************
+ * PRIVATE SLOTS
+ */
+void AppMaintenanceScheduler::check()
+{
+    if (m_tasks.isEmpty())
+    {
+        m_timer.stop();
+        return;
+    }
+    if (!isIdle())
+    {
+        return;
+    }
+    Task task = m_tasks.first();
+    QElapsedTimer timer;
+    timer.start();
+    bool complete = runSlice(task);
+    qint64 duration = timer.nsecsElapsed();
+    m_passDuration += duration;
+    if (complete)
+    {
+        m_tasks.removeFirst();
+        emit taskFinished(task, duration);
+    }
+    if (m_tasks.isEmpty())
+    {
+        m_timer.stop();
+        m_lastPassDuration = m_passDuration;
+        emit passFinished(m_lastPassDuration);
+    }
+}
+
+/*******************************************************************************
+ * PRIVATE FUNCTIONS
+ */
+bool AppMaintenanceScheduler::isIdle()
+{
+    // Frames rendered since the previous check mean animations or other
+    // updates are using the frame budget
+    quint64 renderedFrames = m_window->getRenderedFrames();
+    bool rendering = renderedFrames != m_lastRenderedFrames;
+    m_lastRenderedFrames = renderedFrames;
+    m_window->updateActivity();
+    if (rendering || m_window->getIdleTime() < m_idleDelay)
+    {
+        return false;
+    }
+    QQmlIncubationController* controller = m_window->engine()->incubationController();
+    return !controller || controller->incubatingObjectCount() == 0;
+}
+
+bool AppMaintenanceScheduler::runSlice(Task task)
+{
+    switch (task)
+    {
+    case CollectGarbage:
+        m_window->engine()->collectGarbage();
+        return true;
+    case TrimComponentCache:
+        m_window->engine()->trimComponentCache();
+        return true;
+    case TrimObjectPools:
+    {
+        QList<AppObjectHandler*> handlers = m_window->getHandlers();
+        if (m_handlerCursor < handlers.size())
+        {
+            handlers[m_handlerCursor]->trimPool();
+            ++m_handlerCursor;
+        }
+        return m_handlerCursor >= handlers.size();
+    }
+    }
+    return true;
+}
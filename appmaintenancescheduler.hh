@@ -0,0 +1,100 @@
+#ifndef APPMAINTENANCESCHEDULER_HH
+#define APPMAINTENANCESCHEDULER_HH
+
+#include <QObject>
+#include <QTimer>
+#include <QList>
+#include <QElapsedTimer>
+class AppWindow;
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppMaintenanceScheduler runs memory maintenance of an AppWindow while
+/// the app is idle, so that garbage collection and cache trimming do not land
+/// in the middle of interactive frames. A pass is requested when views or
+/// components are unloaded, and its tasks are run one slice per check once
+/// the window has had no activity for the idle delay, nothing is being
+/// incubated and no frames were rendered since the previous check.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppMaintenanceScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** The tasks of a maintenance pass, in the order they are run. */
+    enum Task
+    {
+        CollectGarbage,     ///< QJSEngine::collectGarbage()
+        TrimComponentCache, ///< QQmlEngine::trimComponentCache()
+        TrimObjectPools     ///< AppObjectHandler::trimPool(), one handler per slice
+    };
+    Q_ENUM(Task)
+
+    /***************************************************************************
+     * CONSTRUCTOR AND DESTRUCTOR
+     */
+    /**
+     * @param window The window whose engine and handlers are maintained
+     */
+    explicit AppMaintenanceScheduler(AppWindow* window);
+
+    virtual ~AppMaintenanceScheduler();
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    /** Queues a maintenance pass to be run when the app is idle. */
+    void requestMaintenance();
+
+    /** Returns true while a pass is queued or running. */
+    bool isPending() const;
+
+    /** Sets how long the window must be without activity before a slice. */
+    void setIdleDelay(int msec);
+
+    /** Sets how often the idle state is checked while a pass is pending. */
+    void setCheckInterval(int msec);
+
+    /** Returns the total duration of the last completed pass in nanoseconds. */
+    qint64 getLastPassDuration() const;
+
+signals:
+    /***************************************************************************
+     * SIGNALS
+     */
+    void taskFinished(AppMaintenanceScheduler::Task task, qint64 durationNsec);
+    void passFinished(qint64 durationNsec);
+
+private slots:
+    /***************************************************************************
+     * PRIVATE SLOTS
+     */
+    /** Runs the next slice if the app is idle. */
+    void check();
+
+private:
+    /***************************************************************************
+     * PRIVATE FUNCTIONS
+     */
+    /** Returns true if a slice can be run without disturbing the frames. */
+    bool isIdle();
+
+    /** Runs one slice of the task. Returns true when the task is complete. */
+    bool runSlice(Task task);
+
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    AppWindow* m_window;
+    QTimer m_timer;                 ///< Runs only while a pass is pending
+    QList<Task> m_tasks;            ///< The remaining tasks of the pass
+    int m_idleDelay;
+    int m_handlerCursor;            ///< The next handler whose pool is trimmed
+    quint64 m_lastRenderedFrames;   ///< Frame count of the previous check
+    qint64 m_passDuration;          ///< Time spent in the slices of the current pass
+    qint64 m_lastPassDuration;
+};
+
+#endif // APPMAINTENANCESCHEDULER_HH
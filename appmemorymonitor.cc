@@ -0,0 +1,403 @@
+#include "appmemorymonitor.hh"
+#include "appwindow.hh"
+#include "appobjecthandler.hh"
+#include "appcomponentregistry.hh"
+#include "appimageprovider.hh"
+#include "applogging.hh"
+#include <QQuickItem>
+#include <QQmlEngine>
+#include <QSet>
+#include <QFile>
+#include <QSocketNotifier>
+
+#if defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(Q_OS_ANDROID)
+#include <jni.h>
+#endif
+
+namespace
+{
+// Rough per-item costs of a QQuickItem created from QML, and of the scene
+// graph nodes of an item in the scene
+const qint64 ITEM_BYTES = 640;
+const qint64 SCENE_GRAPH_BYTES = 256;
+
+// The onTrimMemory() levels of android.content.ComponentCallbacks2
+const int TRIM_MEMORY_RUNNING_MODERATE = 5;
+const int TRIM_MEMORY_RUNNING_LOW = 10;
+const int TRIM_MEMORY_RUNNING_CRITICAL = 15;
+const int TRIM_MEMORY_BACKGROUND = 40;
+}
+
+#if defined(Q_OS_ANDROID)
+extern "C" JNIEXPORT void JNICALL Java_org_app_AppMemoryMonitor_onTrimMemory(JNIEnv*, jclass, jint level)
+{
+    AppMemoryMonitor::handleTrimMemory(level);
+}
+#endif
+
+QList<AppMemoryMonitor*> AppMemoryMonitor::s_monitors;
+QMutex AppMemoryMonitor::s_monitorsMutex;
+
+/*******************************************************************************
+ * CONSTRUCTOR AND DESTRUCTOR
+ */
+AppMemoryMonitor::AppMemoryMonitor(AppWindow* window)
+    : QObject(window)
+    , m_window(window)
+    , m_budget(0)
+{
+    m_timer.setInterval(2000);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(checkBudget()));
+    watchPressure();
+    QMutexLocker locker(&s_monitorsMutex);
+    s_monitors.append(this);
+}
+
+AppMemoryMonitor::~AppMemoryMonitor()
+{
+    {
+        QMutexLocker locker(&s_monitorsMutex);
+        s_monitors.removeAll(this);
+    }
+    // The notifiers go before the descriptors they watch
+    qDeleteAll(m_pressureNotifiers);
+#if defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)
+    for (auto iter = m_pressureLevels.constBegin(); iter != m_pressureLevels.constEnd(); ++iter)
+    {
+        ::close(iter.key());
+    }
+#endif
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ */
+qint64 AppMemoryMonitor::Usage::total() const
+{
+    return views+hiddenViewResources+components+objectItems+pooledItems+decodedImages;
+}
+
+AppMemoryMonitor::Usage AppMemoryMonitor::usage() const
+{
+    // Every item is visited once: the AppObject items are counted apart
+    // from the layers they are in
+    QSet<QQuickItem*> objects = objectItems();
+    Usage usage;
+    usage.views = 0;
+    usage.hiddenViewResources = 0;
+    QStringList views = m_window->getLoadedViews();
+    for (auto iter = views.constBegin(); iter != views.constEnd(); ++iter)
+    {
+        QQuickItem* view = m_window->getView(*iter);
+        qint64 items = subtreeSize(view, objects);
+        usage.views += items*ITEM_BYTES;
+        if (view->parentItem() && !view->isVisible())
+        {
+            usage.hiddenViewResources += items*SCENE_GRAPH_BYTES;
+        }
+    }
+    usage.components = AppComponentRegistry::instance()->stats().estimatedBytes;
+    usage.decodedImages = m_window->imageProvider()->stats().cachedBytes;
+    usage.objectItems = 0;
+    usage.pooledItems = 0;
+    for (auto iter = objects.constBegin(); iter != objects.constEnd(); ++iter)
+    {
+        usage.objectItems += subtreeSize(*iter, QSet<QQuickItem*>())*ITEM_BYTES;
+    }
+    QList<AppObjectHandler*> handlers = m_window->getHandlers();
+    for (auto iter = handlers.constBegin(); iter != handlers.constEnd(); ++iter)
+    {
+        usage.pooledItems += (*iter)->pooledItemCount()*ITEM_BYTES;
+    }
+    return usage;
+}
+
+void AppMemoryMonitor::setBudget(qint64 bytes)
+{
+    m_budget = bytes;
+    if (m_budget > 0)
+    {
+        m_timer.start();
+        checkBudget();
+    }
+    else
+    {
+        m_timer.stop();
+    }
+}
+
+void AppMemoryMonitor::setCheckInterval(int msec)
+{
+    m_timer.setInterval(msec);
+}
+
+void AppMemoryMonitor::handleTrimMemory(int androidLevel)
+{
+    TrimLevel level;
+    if (androidLevel >= TRIM_MEMORY_BACKGROUND)
+    {
+        level = UnloadHiddenViews;
+    }
+    else if (androidLevel >= TRIM_MEMORY_RUNNING_CRITICAL)
+    {
+        level = ReleaseUnusedComponents;
+    }
+    else if (androidLevel >= TRIM_MEMORY_RUNNING_LOW)
+    {
+        level = DropDecodedImages;
+    }
+    else if (androidLevel >= TRIM_MEMORY_RUNNING_MODERATE)
+    {
+        level = DropPooledItems;
+    }
+    else
+    {
+        return;
+    }
+    // Called on the Android UI thread, the monitors trim on their own
+    QMutexLocker locker(&s_monitorsMutex);
+    for (auto iter = s_monitors.constBegin(); iter != s_monitors.constEnd(); ++iter)
+    {
+        AppMemoryMonitor* monitor = *iter;
+        QMetaObject::invokeMethod(monitor, [monitor, level]() {monitor->handleMemoryPressure(level);},
+                                  Qt::QueuedConnection);
+    }
+}
+
+/*******************************************************************************
+ * SLOTS
+ */
+void AppMemoryMonitor::checkBudget()
+{
+    if (m_budget <= 0)
+    {
+        return;
+    }
+    Usage current = usage();
+    qint64 total = current.total();
+    if (total > m_budget)
+    {
+        emit budgetExceeded(total);
+        trimTo(m_budget, current);
+    }
+}
+
+void AppMemoryMonitor::handleMemoryPressure(AppMemoryMonitor::TrimLevel level)
+{
+    trimThrough(level, usage());
+}
+
+void AppMemoryMonitor::handleLowMemory()
+{
+    handleMemoryPressure(UnloadHiddenViews);
+}
+
+/*******************************************************************************
+ * PRIVATE SLOTS
+ */
+void AppMemoryMonitor::pressureTriggered(int fd)
+{
+    qCDebug(lcAppResources) << Q_FUNC_INFO << ": Memory pressure, trimming up to" << m_pressureLevels.value(fd);
+    handleMemoryPressure(m_pressureLevels.value(fd));
+}
+
+/*******************************************************************************
+ * PRIVATE FUNCTIONS
+ */
+void AppMemoryMonitor::trimTo(qint64 target, Usage usage)
+{
+    for (int level = ReleaseHiddenViewResources; level <= UnloadHiddenViews; ++level)
+    {
+        qint64 before = usage.total();
+        if (target > 0 && before <= target)
+        {
+            return;
+        }
+        trim(TrimLevel(level), usage);
+        emit trimmed(TrimLevel(level), before, usage.total());
+    }
+}
+
+void AppMemoryMonitor::trimThrough(TrimLevel deepest, Usage usage)
+{
+    for (int level = ReleaseHiddenViewResources; level <= deepest; ++level)
+    {
+        qint64 before = usage.total();
+        trim(TrimLevel(level), usage);
+        emit trimmed(TrimLevel(level), before, usage.total());
+    }
+}
+
+void AppMemoryMonitor::trim(TrimLevel level, Usage& usage)
+{
+    switch (level)
+    {
+    case ReleaseHiddenViewResources:
+        m_window->releaseHiddenViewResources(0);
+        usage.hiddenViewResources = 0;
+        break;
+    case DropPooledItems:
+    {
+        QList<AppObjectHandler*> handlers = m_window->getHandlers();
+        for (auto iter = handlers.constBegin(); iter != handlers.constEnd(); ++iter)
+        {
+            (*iter)->trimPool();
+        }
+        usage.pooledItems = 0;
+        break;
+    }
+    case DropDecodedImages:
+        m_window->imageProvider()->trimCache();
+        usage.decodedImages = m_window->imageProvider()->stats().cachedBytes;
+        break;
+    case ReleaseUnusedComponents:
+        AppComponentRegistry::instance()->purgeUnused();
+        m_window->engine()->trimComponentCache();
+        usage.components = AppComponentRegistry::instance()->stats().estimatedBytes;
+        break;
+    case UnloadHiddenViews:
+    {
+        QSet<QQuickItem*> objects = objectItems();
+        QSet<QQuickItem*> occupied = viewsWithObjects(objects);
+        QStringList views = m_window->getLoadedViews();
+        for (auto iter = views.constBegin(); iter != views.constEnd(); ++iter)
+        {
+            QQuickItem* view = m_window->getView(*iter);
+            bool hidden = !view->parentItem() || !view->isVisible();
+            if (hidden && !m_window->isViewPinned(*iter)
+                    && !m_window->isViewLoading(*iter) && !occupied.contains(view))
+            {
+                usage.views -= subtreeSize(view, objects)*ITEM_BYTES;
+                m_window->unloadView(*iter);
+            }
+        }
+        break;
+    }
+    }
+}
+
+QSet<QQuickItem*> AppMemoryMonitor::objectItems() const
+{
+    QSet<QQuickItem*> items;
+    QList<AppObjectHandler*> handlers = m_window->getHandlers();
+    for (auto iter = handlers.constBegin(); iter != handlers.constEnd(); ++iter)
+    {
+        QVector<QQuickItem*> live = (*iter)->liveItems();
+        for (auto item = live.constBegin(); item != live.constEnd(); ++item)
+        {
+            items.insert(*item);
+        }
+    }
+    return items;
+}
+
+QSet<QQuickItem*> AppMemoryMonitor::viewsWithObjects(const QSet<QQuickItem*>& objects) const
+{
+    QList<QQuickItem*> starts = objects.values();
+    QList<AppObjectHandler*> handlers = m_window->getHandlers();
+    for (auto iter = handlers.constBegin(); iter != handlers.constEnd(); ++iter)
+    {
+        QVector<QQuickItem*> layers = (*iter)->cachedLayers();
+        for (auto layer = layers.constBegin(); layer != layers.constEnd(); ++layer)
+        {
+            starts.append(*layer);
+        }
+    }
+    // The ancestors are collected once, a climb stops where another ended
+    QSet<QQuickItem*> ancestors;
+    for (auto iter = starts.constBegin(); iter != starts.constEnd(); ++iter)
+    {
+        for (QQuickItem* item = *iter; item && !ancestors.contains(item); item = item->parentItem())
+        {
+            ancestors.insert(item);
+        }
+    }
+    QSet<QQuickItem*> views;
+    QStringList names = m_window->getLoadedViews();
+    for (auto iter = names.constBegin(); iter != names.constEnd(); ++iter)
+    {
+        QQuickItem* view = m_window->getView(*iter);
+        if (ancestors.contains(view))
+        {
+            views.insert(view);
+        }
+    }
+    return views;
+}
+
+void AppMemoryMonitor::watchPressure()
+{
+#if defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)
+    // The cgroup of the process limits it before the whole system runs low
+    QByteArray path = "/proc/pressure/memory";
+    QFile cgroups("/proc/self/cgroup");
+    if (cgroups.open(QIODevice::ReadOnly))
+    {
+        QList<QByteArray> lines = cgroups.readAll().split('\n');
+        for (auto iter = lines.constBegin(); iter != lines.constEnd(); ++iter)
+        {
+            if (iter->startsWith("0::"))
+            {
+                QByteArray cgroupPath = "/sys/fs/cgroup"+iter->mid(3).trimmed()+"/memory.pressure";
+                if (QFile::exists(QString::fromLocal8Bit(cgroupPath)))
+                {
+                    path = cgroupPath;
+                }
+            }
+        }
+    }
+    // Stalls of 150 ms in a 2 s window, the shortest unprivileged window
+    if (!addPressureTrigger(path, "some 150000 2000000", DropDecodedImages)
+            || !addPressureTrigger(path, "full 150000 2000000", UnloadHiddenViews))
+    {
+        qCDebug(lcAppResources) << Q_FUNC_INFO << ": The memory pressure of " << path << " cannot be watched";
+    }
+#endif
+}
+
+bool AppMemoryMonitor::addPressureTrigger(const QByteArray& path, const QByteArray& trigger, TrimLevel level)
+{
+#if defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)
+    int fd = ::open(path.constData(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    // The trigger string is written with its terminating null
+    if (::write(fd, trigger.constData(), trigger.size()+1) < 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    // The kernel signals a trigger with POLLPRI
+    QSocketNotifier* notifier = new QSocketNotifier(fd, QSocketNotifier::Exception, this);
+    connect(notifier, SIGNAL(activated(int)), this, SLOT(pressureTriggered(int)));
+    m_pressureNotifiers.append(notifier);
+    m_pressureLevels.insert(fd, level);
+    return true;
+#else
+    Q_UNUSED(path);
+    Q_UNUSED(trigger);
+    Q_UNUSED(level);
+    return false;
+#endif
+}
+
+qint64 AppMemoryMonitor::subtreeSize(QQuickItem* item, const QSet<QQuickItem*>& excluded)
+{
+    qint64 count = 1;
+    QList<QQuickItem*> children = item->childItems();
+    for (auto iter = children.constBegin(); iter != children.constEnd(); ++iter)
+    {
+        if (!excluded.contains(*iter))
+        {
+            count += subtreeSize(*iter, excluded);
+        }
+    }
+    return count;
+}
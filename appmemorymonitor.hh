@@ -0,0 +1,177 @@
+#ifndef APPMEMORYMONITOR_HH
+#define APPMEMORYMONITOR_HH
+
+#include <QObject>
+#include <QTimer>
+#include <QSet>
+#include <QHash>
+#include <QMutex>
+class AppWindow;
+class QQuickItem;
+class QSocketNotifier;
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppMemoryMonitor estimates the memory held by the caches of an
+/// AppWindow and its AppObjectHandlers, and trims them when a budget is
+/// exceeded or the system is low on memory. The estimates are based on item
+/// counts and source sizes, so they are meant for budgeting, not exact
+/// accounting. The caches are trimmed in order of how cheap they are to
+/// restore:
+///   1. scene graph resources of views hidden by visibility
+///   2. pooled items of the handlers
+///   3. decoded images in the cache of the AppImageProvider
+///   4. compiled components without users
+///   5. hidden views that are not pinned (see AppWindow::setViewPinned()) and
+///      hold no AppObject items or layers
+///
+/// The memory pressure of the system trims the levels up to one that
+/// matches its severity. On Linux the pressure stall information of the
+/// cgroup of the process, or of the whole system, is watched: memory stalls
+/// of some tasks trim up to DropDecodedImages, and stalls of all the tasks
+/// trim every level. On Android, forward the onTrimMemory() callbacks of the
+/// activity to handleTrimMemory(), for example through a class
+/// org.app.AppMemoryMonitor that declares
+/// "public static native void onTrimMemory(int level);".
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppMemoryMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** The trimming levels, cheapest to restore first. */
+    enum TrimLevel
+    {
+        ReleaseHiddenViewResources,
+        DropPooledItems,
+        DropDecodedImages,
+        ReleaseUnusedComponents,
+        UnloadHiddenViews
+    };
+    Q_ENUM(TrimLevel)
+
+    /** Estimated memory use per category, in bytes. */
+    struct Usage
+    {
+        qint64 views;               ///< Items of the loaded views
+        qint64 hiddenViewResources; ///< Scene graph nodes kept by views hidden by visibility
+        qint64 components;          ///< Compiled components in the AppComponentRegistry
+        qint64 objectItems;         ///< Live items of the AppObjects
+        qint64 pooledItems;         ///< Released items kept in the handler pools
+        qint64 decodedImages;       ///< Images in the cache of the AppImageProvider
+
+        qint64 total() const;
+    };
+
+    /***************************************************************************
+     * CONSTRUCTOR AND DESTRUCTOR
+     */
+    /**
+     * @param window The window whose caches are accounted
+     */
+    explicit AppMemoryMonitor(AppWindow* window);
+
+    virtual ~AppMemoryMonitor();
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    /** Returns the current estimate. */
+    Usage usage() const;
+
+    /**
+     * Sets the memory budget. The usage is checked periodically and the
+     * caches are trimmed when it goes over the budget.
+     * @param bytes The budget, 0 for none
+     */
+    void setBudget(qint64 bytes);
+    qint64 getBudget() const {return m_budget;}
+
+    /** Sets how often the usage is checked against the budget. */
+    void setCheckInterval(int msec);
+
+    /**
+     * Trims all the monitors by the level of an Android onTrimMemory()
+     * callback. Can be called from any thread.
+     */
+    static void handleTrimMemory(int androidLevel);
+
+public slots:
+    /***************************************************************************
+     * SLOTS
+     */
+    /** Trims the caches until the usage is under the budget. */
+    void checkBudget();
+
+    /**
+     * Trims the levels up to and including the given one regardless of the
+     * budget. Called on the memory pressure of the system, or call it to
+     * simulate that.
+     */
+    void handleMemoryPressure(AppMemoryMonitor::TrimLevel level);
+
+    /** Trims all the levels, as on critical memory pressure. */
+    void handleLowMemory();
+
+signals:
+    /***************************************************************************
+     * SIGNALS
+     */
+    void trimmed(AppMemoryMonitor::TrimLevel level, qint64 bytesBefore, qint64 bytesAfter);
+    void budgetExceeded(qint64 bytes);
+
+private:
+    /***************************************************************************
+     * PRIVATE FUNCTIONS
+     */
+    /** Trims one level, and updates the usage by what was released. */
+    void trim(TrimLevel level, Usage& usage);
+
+    /** Trims level by level until the usage is at most the target.
+     * @param usage The usage measured before the trim */
+    void trimTo(qint64 target, Usage usage);
+
+    /** Trims the levels up to and including the given one. */
+    void trimThrough(TrimLevel deepest, Usage usage);
+
+    /** Returns the views that hold AppObject items or handler layers, which
+     * would be deleted under the objects if the view was unloaded. */
+    QSet<QQuickItem*> viewsWithObjects(const QSet<QQuickItem*>& objects) const;
+
+    /** Starts watching the memory pressure of the system, where supported. */
+    void watchPressure();
+
+    /** Adds a pressure stall trigger for the level, false if not supported. */
+    bool addPressureTrigger(const QByteArray& path, const QByteArray& trigger, TrimLevel level);
+
+    /** Returns the live items of the AppObjects, which are accounted
+     * separately from the views they are in. */
+    QSet<QQuickItem*> objectItems() const;
+
+    /** Returns the number of items in the visual subtree of the item,
+     * excluding the subtrees of the given items. */
+    static qint64 subtreeSize(QQuickItem* item, const QSet<QQuickItem*>& excluded);
+
+private slots:
+    /***************************************************************************
+     * PRIVATE SLOTS
+     */
+    /** Trims by the level of the pressure trigger that fired. */
+    void pressureTriggered(int fd);
+
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    AppWindow* m_window;
+    QTimer m_timer;      ///< Runs only while a budget is set
+    qint64 m_budget;
+    QHash<int, TrimLevel> m_pressureLevels;             ///< Trim level of each pressure trigger by file descriptor
+    QList<QSocketNotifier*> m_pressureNotifiers;
+
+    static QList<AppMemoryMonitor*> s_monitors;         ///< For handleTrimMemory()
+    static QMutex s_monitorsMutex;
+};
+
+#endif // APPMEMORYMONITOR_HH
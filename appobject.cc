@@ -1,5 +1,7 @@
 #include "appobject.hh"
-#include "QDebug"
+#include "appobjectpool.hh"
+#include "apprecorder.hh"
+#include "applogging.hh"
 #include <QQmlIncubator>
 #include <QCoreApplication>
 #include <QQmlEngine>
@@ -20,12 +22,43 @@ AppObject::AppObject(AppWindow* window, AppObjectHandler* handler)
     , m_width(0)
     , m_height(0)
     , m_rotation(0)
+    , m_materialized(!handler->isVirtualized())
+    , m_handlerIndex(-1)
 {
+    m_handler->registerObject(this);
 }
 
 AppObject::~AppObject()
 {
-    qDeleteAll(m_hashItems);
+    dematerialize();
+    for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
+    {
+        delete iter->quickItem;
+    }
+    m_handler->unregisterObject(this);
+}
+
+/*******************************************************************************
+ * ALLOCATION
+ */
+void* AppObject::operator new(std::size_t size)
+{
+    return AppObjectPool::allocateUnpooled(size);
+}
+
+void* AppObject::operator new(std::size_t size, AppObjectHandler* handler)
+{
+    return handler->m_objectPool.allocate(size);
+}
+
+void AppObject::operator delete(void* pointer)
+{
+    AppObjectPool::deallocate(pointer);
+}
+
+void AppObject::operator delete(void* pointer, AppObjectHandler*)
+{
+    AppObjectPool::deallocate(pointer);
 }
 
 /*******************************************************************************
@@ -33,22 +66,69 @@ AppObject::~AppObject()
  */
 void AppObject::addQuickItem(const QString& qmlPath, const QString& name, const QString& layer)
 {
+    if (m_handler->isVirtualized())
+    {
+        addQuickItem(qmlPath, name, layer, QVariantMap());
+        return;
+    }
+    if (m_window->recorder())
+    {
+        m_window->recorder()->recordAddItem(this, qmlPath, name, layer, QVariant());
+    }
     // Create the visual enemy and place it into the correct layer
-    QQuickItem* quickItem = m_handler->getQuickItemFromComponent(qmlPath);
+    QQuickItem* itemLayer = qobject_cast<QQuickItem*>(m_window->getByObjectName(layer));
+    if (!itemLayer)
+    {
+        appCWarning(lcAppLayers, layer) << Q_FUNC_INFO << ": The layer "+layer+" cannot be found!";
+    }
+    QQuickItem* quickItem = m_handler->getQuickItemFromComponent(qmlPath, QVariantMap(), itemLayer);
     if (quickItem == 0)
     {
-        qWarning() << Q_FUNC_INFO << ": The component "+qmlPath+" cannot be found!";
+        appCWarning(lcAppComponents, qmlPath) << Q_FUNC_INFO << ": The component "+qmlPath+" cannot be found!";
     }
     else
     {
-        QObject* itemLayer = m_window->getByObjectName(layer);
-        if (!itemLayer)
+        insertItem(name, quickItem, qmlPath, layer);
+    }
+}
+
+void AppObject::addQuickItem(const QString& qmlPath,
+                             const QString& name,
+                             const QString& layer,
+                             const QVariantMap& initialProperties)
+{
+    if (m_window->recorder())
+    {
+        m_window->recorder()->recordAddItem(this, qmlPath, name, layer, initialProperties);
+    }
+    if (m_handler->isVirtualized())
+    {
+        // The item is created when the object enters the viewport
+        insertItem(name, 0, qmlPath, layer, &initialProperties);
+        if (m_materialized)
         {
-            qWarning() << Q_FUNC_INFO << ": The layer "+layer+" cannot be found!";
+            materialize();
         }
-        quickItem->setParent(itemLayer);
-        quickItem->setParentItem(qobject_cast<QQuickItem*>(itemLayer));
-        m_hashItems[name] = quickItem;
+        return;
+    }
+    QVariantMap properties = initialGeometry();
+    for (auto iter = initialProperties.constBegin(); iter != initialProperties.constEnd(); ++iter)
+    {
+        properties[iter.key()] = iter.value();
+    }
+    QQuickItem* itemLayer = qobject_cast<QQuickItem*>(m_window->getByObjectName(layer));
+    if (!itemLayer)
+    {
+        appCWarning(lcAppLayers, layer) << Q_FUNC_INFO << ": The layer "+layer+" cannot be found!";
+    }
+    QQuickItem* quickItem = m_handler->getQuickItemFromComponent(qmlPath, properties, itemLayer);
+    if (quickItem == 0)
+    {
+        appCWarning(lcAppComponents, qmlPath) << Q_FUNC_INFO << ": The component "+qmlPath+" cannot be found!";
+    }
+    else
+    {
+        insertItem(name, quickItem, qmlPath, layer);
     }
 }
 
@@ -58,7 +138,7 @@ QQuickItem* AppObject::getQuickItem(const QString& qmlPath)
     QQuickItem* quickItem = m_handler->getQuickItemFromComponent(qmlPath);
     if (quickItem == 0)
     {
-        qWarning() << Q_FUNC_INFO << ": The component "+qmlPath+" cannot be found!";
+        appCWarning(lcAppComponents, qmlPath) << Q_FUNC_INFO << ": The component "+qmlPath+" cannot be found!";
     }
     return quickItem;
 }
@@ -68,139 +148,382 @@ void AppObject::setQuickItem(QQuickItem* item, const QString& name, const QStrin
     QObject* itemLayer = m_window->getByObjectName(layer);
     if (!itemLayer)
     {
-        qWarning() << Q_FUNC_INFO << ": The layer "+layer+" cannot be found!";
+        appCWarning(lcAppLayers, layer) << Q_FUNC_INFO << ": The layer "+layer+" cannot be found!";
     }
     item->setParent(itemLayer);
     item->setParentItem(qobject_cast<QQuickItem*>(itemLayer));
-    m_hashItems[name] = item;
+    insertItem(name, item, QString(), layer);
 }
 
 void AppObject::removeQuickItem(const QString& name)
 {
-    m_hashItems[name]->deleteLater();
-    m_hashItems.remove(name);
+    if (m_window->recorder())
+    {
+        m_window->recorder()->recordRemoveItem(this, name);
+    }
+    m_window->markActive();
+    int index = indexOfItem(name);
+    if (index < 0)
+    {
+        appCWarning(lcAppObjects, name) << Q_FUNC_INFO << ": The target "+name+" was not found!";
+        return;
+    }
+    Item item = m_items[index];
+    m_items.remove(index);
+    disposeItem(item);
 }
 
 void AppObject::setProperties(const char* property, const QVariant &value)
 {
-    QHash<QString, QQuickItem*>::const_iterator i = m_hashItems.constBegin();
-    while (i != m_hashItems.constEnd()) {
-        bool propertyExists = i.value()->setProperty(property,value);
-        if (!propertyExists)
+    if (m_window->recorder())
+    {
+        m_window->recorder()->recordProperties(this, property, value);
+    }
+    m_window->markActive();
+    for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
+    {
+        if (iter->isVirtual)
+        {
+            iter->state[property] = value;
+        }
+        if (iter->quickItem)
         {
-            qWarning() << Q_FUNC_INFO << ": The property " << property << " on " + i.key() + " was not found but was created!";
+            bool propertyExists = iter->quickItem->setProperty(property,value);
+            if (!propertyExists)
+            {
+                appCWarning(lcAppObjects, QString::fromUtf8(property)) << Q_FUNC_INFO << ": The property " << property << " on " + iter->name + " was not found but was created!";
+            }
         }
-        ++i;
     }
 }
 
 void AppObject::setProperty(const QString& target, const char* property, const QVariant &value)
 {
-    QQuickItem* item = m_hashItems[target];
-    if (item)
+    if (m_window->recorder())
     {
-        bool propertyExists = item->setProperty(property, value);
+        m_window->recorder()->recordProperty(this, target, property, value);
+    }
+    m_window->markActive();
+    int index = indexOfItem(target);
+    if (index < 0)
+    {
+        appCWarning(lcAppObjects, target) << Q_FUNC_INFO << ": The target "+target+" was not found!";
+        return;
+    }
+    Item& item = m_items[index];
+    if (item.isVirtual)
+    {
+        item.state[property] = value;
+    }
+    if (item.quickItem)
+    {
+        bool propertyExists = item.quickItem->setProperty(property, value);
         if (!propertyExists)
         {
-            qWarning() << Q_FUNC_INFO << ": The property " << property << " on " + target + " was not found but was created!";
+            appCWarning(lcAppObjects, QString::fromUtf8(property)) << Q_FUNC_INFO << ": The property " << property << " on " + target + " was not found but was created!";
         }
     }
-    else
-    {
-        qWarning() << Q_FUNC_INFO << ": The target "+target+" was not found!";
-    }
 }
 
 void AppObject::changeLayer(const QString &target, const QString &layerName)
 {
-    QObject *itemLayer = m_window->rootObject()->findChild<QObject*>(layerName);
-    QQuickItem * item = m_hashItems[target];
-    if (item)
+    if (m_window->recorder())
     {
-        item->setParent(itemLayer);
-        item->setParentItem(qobject_cast<QQuickItem *>(itemLayer));
+        m_window->recorder()->recordChangeLayer(this, target, layerName);
     }
-    else
+    m_window->markActive();
+    int index = indexOfItem(target);
+    if (index < 0)
     {
-        qWarning() << "AppObject::setProperty(): The target "+target+" was not found!";
+        appCWarning(lcAppObjects, target) << "AppObject::changeLayer(): The target "+target+" was not found!";
+        return;
+    }
+    Item& item = m_items[index];
+    item.layer = layerName;
+    if (item.quickItem)
+    {
+        QObject *itemLayer = m_window->rootObject()->findChild<QObject*>(layerName);
+        // Reparenting rebuilds the scene graph subtree, so it is skipped when
+        // the item already is on the layer
+        if (item.quickItem->parentItem() != itemLayer || !itemLayer)
+        {
+            item.quickItem->setParent(itemLayer);
+            item.quickItem->setParentItem(qobject_cast<QQuickItem *>(itemLayer));
+        }
     }
 }
 
 void AppObject::setX(float x)
 {
+    if (m_window->recorder())
+    {
+        m_window->recorder()->recordGeometry(this, AppRecorder::X, x);
+    }
     m_x = x;
     m_centerX = x+m_width/2.0;
-    for (auto iter = m_hashItems.begin(); iter != m_hashItems.end(); ++iter)
+    for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
     {
-        (*iter)->setX(x);
+        if (iter->quickItem)
+        {
+            iter->quickItem->setX(x);
+        }
     }
+    geometryChanged();
 }
 
 void AppObject::setY(float y)
 {
+    if (m_window->recorder())
+    {
+        m_window->recorder()->recordGeometry(this, AppRecorder::Y, y);
+    }
     m_y = y;
     m_centerY = y+m_height/2.0;
-    for (auto iter = m_hashItems.begin(); iter != m_hashItems.end(); ++iter)
+    for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
     {
-        (*iter)->setY(y);
+        if (iter->quickItem)
+        {
+            iter->quickItem->setY(y);
+        }
     }
+    geometryChanged();
 }
 
 void AppObject::setZ(int z)
 {
+    if (m_window->recorder())
+    {
+        m_window->recorder()->recordZ(this, z);
+    }
+    m_window->markActive();
     m_z = z;
-    for (auto iter = m_hashItems.begin(); iter != m_hashItems.end(); ++iter)
+    for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
     {
-        (*iter)->setZ(z);
+        if (iter->quickItem)
+        {
+            iter->quickItem->setZ(z);
+        }
     }
 }
 
 void AppObject::setCenterX(float centerX)
 {
+    if (m_window->recorder())
+    {
+        m_window->recorder()->recordGeometry(this, AppRecorder::CenterX, centerX);
+    }
     m_centerX = centerX;
     m_x = centerX-m_width/2.0;
-    for (auto iter = m_hashItems.begin(); iter != m_hashItems.end(); ++iter)
+    for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
     {
-        (*iter)->setX(m_x);
+        if (iter->quickItem)
+        {
+            iter->quickItem->setX(m_x);
+        }
     }
+    geometryChanged();
 }
 
 void AppObject::setCenterY(float centerY)
 {
+    if (m_window->recorder())
+    {
+        m_window->recorder()->recordGeometry(this, AppRecorder::CenterY, centerY);
+    }
     m_centerY = centerY;
     m_y = centerY-m_height/2.0;
-    for (auto iter = m_hashItems.begin(); iter != m_hashItems.end(); ++iter)
+    for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
     {
-        (*iter)->setX(m_y);
+        if (iter->quickItem)
+        {
+            iter->quickItem->setY(m_y);
+        }
     }
+    geometryChanged();
 }
 
 void AppObject::setWidth(float width)
 {
+    if (m_window->recorder())
+    {
+        m_window->recorder()->recordGeometry(this, AppRecorder::Width, width);
+    }
     m_width = width;
     m_centerX = m_x+m_width/2.0;
-    for (auto iter = m_hashItems.begin(); iter != m_hashItems.end(); ++iter)
+    for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
     {
-        (*iter)->setWidth(width);
+        if (iter->quickItem)
+        {
+            iter->quickItem->setWidth(width);
+        }
     }
+    geometryChanged();
 }
 
 void AppObject::setHeight(float height)
 {
+    if (m_window->recorder())
+    {
+        m_window->recorder()->recordGeometry(this, AppRecorder::Height, height);
+    }
     m_height = height;
     m_centerY = m_y+m_height/2.0;
-    for (auto iter = m_hashItems.begin(); iter != m_hashItems.end(); ++iter)
+    for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
     {
-        (*iter)->setHeight(height);
+        if (iter->quickItem)
+        {
+            iter->quickItem->setHeight(height);
+        }
     }
+    geometryChanged();
 }
 
 void AppObject::setRotation(float rotation)
 {
+    if (m_window->recorder())
+    {
+        m_window->recorder()->recordGeometry(this, AppRecorder::Rotation, rotation);
+    }
+    m_window->markActive();
     m_rotation = rotation;
-    for (auto iter = m_hashItems.begin(); iter != m_hashItems.end(); ++iter)
+    for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
+    {
+        if (iter->quickItem)
+        {
+            iter->quickItem->setRotation(rotation);
+        }
+    }
+}
+
+QRectF AppObject::boundingRect() const
+{
+    return QRectF(m_x, m_y, m_width, m_height);
+}
+
+/*******************************************************************************
+ * PROTECTED FUNCTIONS
+ */
+QVariantMap AppObject::initialGeometry() const
+{
+    QVariantMap geometry;
+    geometry["x"] = m_x;
+    geometry["y"] = m_y;
+    geometry["z"] = m_z;
+    geometry["rotation"] = m_rotation;
+    // An unset size leaves the implicit size of the component in use
+    if (m_width != 0)
+    {
+        geometry["width"] = m_width;
+    }
+    if (m_height != 0)
+    {
+        geometry["height"] = m_height;
+    }
+    return geometry;
+}
+
+void AppObject::materialize()
+{
+    m_materialized = true;
+    QVariantMap geometry = initialGeometry();
+    for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
+    {
+        if (!iter->isVirtual || iter->quickItem)
+        {
+            continue;
+        }
+        QVariantMap state = iter->state;
+        for (auto property = geometry.constBegin(); property != geometry.constEnd(); ++property)
+        {
+            state[property.key()] = property.value();
+        }
+        iter->quickItem = m_handler->acquireItem(iter->qmlPath, iter->layer, state);
+    }
+}
+
+void AppObject::dematerialize()
+{
+    m_materialized = false;
+    for (auto iter = m_items.begin(); iter != m_items.end(); ++iter)
     {
-        (*iter)->setProperty("rotation",rotation);
+        if (iter->isVirtual && iter->quickItem)
+        {
+            m_handler->releaseItem(iter->qmlPath, iter->quickItem, iter->state);
+            iter->quickItem = 0;
+        }
     }
 }
 
+void AppObject::geometryChanged()
+{
+    m_window->markActive();
+    if (hasVirtualItems())
+    {
+        m_handler->scheduleViewportUpdate();
+    }
+}
+
+int AppObject::indexOfItem(const QString& name) const
+{
+    for (int i = 0; i < m_items.size(); ++i)
+    {
+        if (m_items[i].name == name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void AppObject::insertItem(const QString& name,
+                           QQuickItem* quickItem,
+                           const QString& qmlPath,
+                           const QString& layer,
+                           const QVariantMap* state)
+{
+    m_window->markActive();
+    Item item = {name, quickItem, qmlPath, layer, state != 0, state ? *state : QVariantMap()};
+    int index = indexOfItem(name);
+    if (index < 0)
+    {
+        m_items.append(item);
+    }
+    else
+    {
+        // The replaced item would otherwise stay in its layer
+        Item replaced = m_items[index];
+        m_items[index] = item;
+        if (replaced.quickItem != quickItem)
+        {
+            disposeItem(replaced);
+        }
+    }
+}
+
+void AppObject::disposeItem(const Item& item)
+{
+    if (!item.quickItem)
+    {
+        return;
+    }
+    if (item.isVirtual)
+    {
+        m_handler->releaseItem(item.qmlPath, item.quickItem, item.state);
+    }
+    else
+    {
+        item.quickItem->deleteLater();
+    }
+}
+
+bool AppObject::hasVirtualItems() const
+{
+    for (int i = 0; i < m_items.size(); ++i)
+    {
+        if (m_items[i].isVirtual)
+        {
+            return true;
+        }
+    }
+    return false;
+}
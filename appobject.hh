@@ -5,6 +5,7 @@
 #include "appobjecthandler.hh"
 #include <QObject>
 #include <QQuickItem>
+#include <QVarLengthArray>
 
 ////////////////////////////////////////////////////////////////////////////////
 ///
@@ -14,11 +15,17 @@
 /// these other QQuickItems would be, because it has to able to relocate the
 /// QQuickItems to different "layers".
 ///
+/// The items are stored inline in the object, as an object typically has only
+/// a few of them. AppObjects can be allocated from the arena of their handler
+/// with new (handler) AppObject(window, handler).
+///
 ////////////////////////////////////////////////////////////////////////////////
 
 class AppObject : public QObject
 {
     Q_OBJECT
+    friend class AppObjectHandler;
+    friend class AppRecorder;
 
 public:
     /***************************************************************************
@@ -37,6 +44,30 @@ public:
      */
     virtual ~AppObject();
 
+    /***************************************************************************
+     * ALLOCATION
+     */
+    /** Allocates the object from the global heap. */
+    static void* operator new(std::size_t size);
+
+    /** Allocates the object from the arena of the handler. */
+    static void* operator new(std::size_t size, AppObjectHandler* handler);
+
+    /** Returns the memory to wherever it was allocated from. */
+    static void operator delete(void* pointer);
+    static void operator delete(void* pointer, AppObjectHandler* handler);
+
+    /** A visual part of this object. */
+    struct Item
+    {
+        QString name;
+        QQuickItem* quickItem;  ///< Null while a virtual item is not materialized
+        QString qmlPath;        ///< Empty for items given with setQuickItem()
+        QString layer;
+        bool isVirtual;         ///< Created only while the object is near the viewport
+        QVariantMap state;      ///< Remembered properties of a virtual item
+    };
+
     /***************************************************************************
      * PUBLIC FUNCTIONS
      */
@@ -53,6 +84,19 @@ public:
                       const QString& name,
                       const QString& layer);
 
+    /**
+     * Creates the QQuickItem directly into the layer with the current geometry
+     * of this object and the given initial properties. The values are applied
+     * before the component is completed, so the item is born in its final
+     * state.
+     * @param initialProperties Property values that are applied on top of the
+     * geometry of this object
+     */
+    void addQuickItem(const QString& qmlPath,
+                      const QString& name,
+                      const QString& layer,
+                      const QVariantMap& initialProperties);
+
     /** Removes a QuickItem from this Object. */
     void removeQuickItem(const QString& name);
 
@@ -68,7 +112,7 @@ public:
     void changeLayer(const QString& target, const QString& newLayer);
 
     // Setters. These functions set the property of all the QQuickItems in the
-    // m_hashItems.
+    // m_items.
     void setX(float x);
     void setY(float y);
     void setZ(int z);
@@ -88,13 +132,59 @@ public:
     float getHeight() const   {return m_height;}
     float getRotation() const {return m_rotation;}
 
+    /** Returns the area covered by this object. */
+    QRectF boundingRect() const;
+
+    /**
+     * Returns true if the QQuickItems of this object exist. Objects of a
+     * virtualized AppObjectHandler only have their items while they are near
+     * the viewport.
+     */
+    bool isMaterialized() const {return m_materialized;}
+
 protected:
+    /***************************************************************************
+     * PROTECTED FUNCTIONS
+     */
+    /** Returns the current geometry of this object as initial properties. */
+    QVariantMap initialGeometry() const;
+
+    /**
+     * Acquires the QQuickItems of the virtual items from the handler and
+     * applies the state of this object to them.
+     */
+    void materialize();
+
+    /** Releases the QQuickItems of the virtual items back to the handler. */
+    void dematerialize();
+
+    /** Marks the window active and asks a virtualized handler to re-check
+     * this object against the viewport. */
+    void geometryChanged();
+
+    /** Returns the index of the named item in m_items, or -1. */
+    int indexOfItem(const QString& name) const;
+
+    /** Adds or replaces the named item in m_items. A replaced item is
+     * disposed of. The item is virtual if state is given. */
+    void insertItem(const QString& name,
+                    QQuickItem* quickItem,
+                    const QString& qmlPath,
+                    const QString& layer,
+                    const QVariantMap* state=0);
+
+    /** Returns the item to the pool if it is virtual, or deletes it. */
+    void disposeItem(const Item& item);
+
+    /** Returns true if any of the items is virtual. */
+    bool hasVirtualItems() const;
+
     /***************************************************************************
      * PROTECTED VARIABLES
      */
     AppWindow* m_window;                      // The window where these objects are placed in
     AppObjectHandler* m_handler;              // Gives quick access to the parent handler
-    QHash<QString, QQuickItem*> m_hashItems;  // All the visual parts of this object are stored in a hash
+    QVarLengthArray<Item, 4> m_items;         // All the visual parts of this object, looked up linearly by name
     float m_x;
     float m_y;
     int m_z;
@@ -103,6 +193,10 @@ protected:
     float m_width;
     float m_height;
     float m_rotation;
+    bool m_materialized;
+    int m_handlerIndex;                       // Index of this object in the handler's registry
 };
 
+Q_DECLARE_TYPEINFO(AppObject::Item, Q_MOVABLE_TYPE);
+
 #endif // APPOBJECT_HH
@@ -1,11 +1,50 @@
 #include "appobjecthandler.hh"
 #include "appwindow.hh"
-#include <QDebug>
+#include "appobject.hh"
+#include "appitemincubator.hh"
+#include "appcomponentregistry.hh"
+#include "appmaintenancescheduler.hh"
+#include "apprecorder.hh"
+#include "applogging.hh"
 #include <QQmlEngine>
 #include <QQmlContext>
 #include <QQmlIncubator>
 #include <QCoreApplication>
 #include <QQmlIncubationController>
+#include <QMetaProperty>
+#include <QFile>
+#include <QDataStream>
+#include <QTimer>
+#include <QSet>
+#include <algorithm>
+#include <functional>
+
+namespace
+{
+/** A QQuickItem touched by a bulk update and the index of that update. */
+struct BulkEntry
+{
+    QQuickItem* item;
+    QQuickItem* layer;
+    const char* type;   // Class name of the component, shared by all of its instances
+    const QString* qmlPath;
+    int update;
+};
+
+/** Orders the entries by layer and then by component. */
+bool bulkEntryLessThan(const BulkEntry& a, const BulkEntry& b)
+{
+    if (a.layer != b.layer)
+    {
+        return std::less<QQuickItem*>()(a.layer, b.layer);
+    }
+    return std::less<const char*>()(a.type, b.type);
+}
+
+/** The start of a snapshot, followed by the version byte. */
+const char SNAPSHOT_MAGIC[] = "APPS";
+const quint8 SNAPSHOT_VERSION = 1;
+}
 
 /*******************************************************************************
  * CONSTRUCTOR AND DESTRUCTOR
@@ -14,17 +53,91 @@ AppObjectHandler::AppObjectHandler(AppWindow* window,
                                    QObject* parent)
     : QObject(parent)
     , m_window(window)
+    , m_virtualized(false)
+    , m_viewportUpdatePending(false)
+    , m_viewportMargin(0)
+    , m_poolCapacity(64)
+    , m_restoreNext(0)
+    , m_restoreBatchSize(64)
+    , m_lastRestoreNsec(0)
 {
+    m_window->registerHandler(this);
 }
 
 AppObjectHandler::~AppObjectHandler()
 {
-    qDeleteAll(m_components);
+    // The objects unregister themselves, so they are deleted before the
+    // registry and the pools are destroyed
+    while (!m_objects.isEmpty())
+    {
+        delete m_objects.last();
+    }
+    trimPool();
+    for (auto iter = m_components.constBegin(); iter != m_components.constEnd(); ++iter)
+    {
+        AppComponentRegistry::instance()->release(*iter);
+    }
 }
 
 /*******************************************************************************
  * METHODS
  */
+void AppObjectHandler::setWindow(AppWindow* window)
+{
+    if (window == m_window)
+    {
+        return;
+    }
+    AppWindow* previous = m_window;
+    previous->unregisterHandler(this);
+    previous->markActive();
+    m_window = window;
+    m_window->registerHandler(this);
+    m_layers.clear();
+    if (previous->engine() != m_window->engine())
+    {
+        // Components and pooled items cannot cross engines
+        trimPool();
+        for (auto iter = m_components.begin(); iter != m_components.end(); ++iter)
+        {
+            QObject::disconnect(*iter, 0, this, 0);
+            AppComponentRegistry::instance()->release(*iter);
+            *iter = AppComponentRegistry::instance()->acquire(m_window->engine(),
+                                                              m_window->properQUrl(m_window->getRootFolderPath()+iter.key()));
+        }
+    }
+    for (auto iter = m_objects.constBegin(); iter != m_objects.constEnd(); ++iter)
+    {
+        AppObject* object = *iter;
+        object->m_window = m_window;
+        for (int i = 0; i < object->m_items.size(); ++i)
+        {
+            AppObject::Item& item = object->m_items[i];
+            if (item.quickItem && !item.layer.isEmpty())
+            {
+                // Both parents move, as the previous window deletes the
+                // children of its layers
+                QQuickItem* layer = findLayer(item.layer);
+                item.quickItem->setParentItem(layer);
+                if (layer)
+                {
+                    item.quickItem->setParent(layer);
+                }
+                else
+                {
+                    // Kept out of the scene until the object removes it
+                    item.quickItem->setParent(this);
+                }
+            }
+        }
+    }
+    if (m_virtualized)
+    {
+        scheduleViewportUpdate();
+    }
+    m_window->markActive();
+}
+
 void AppObjectHandler::loadComponent(QString qmlPath,
                                      QQmlComponent::CompilationMode compilationMode,
                                      QQmlEngine* engine)
@@ -34,12 +147,13 @@ void AppObjectHandler::loadComponent(QString qmlPath,
     }
     if (m_components.contains(qmlPath))
     {
-        qWarning() << Q_FUNC_INFO << ": The component "+qmlPath+" is already loaded!";
+        appCWarning(lcAppComponents, qmlPath) << Q_FUNC_INFO << ": The component "+qmlPath+" is already loaded!";
         return;
     }
-    QQmlComponent* component = new QQmlComponent(engine,
-                                                 m_window->properQUrl(m_window->getRootFolderPath()+qmlPath),
-                                                 compilationMode);
+    // Shared with the other handlers and windows using the same component
+    QQmlComponent* component = AppComponentRegistry::instance()->acquire(engine,
+                                                                         m_window->properQUrl(m_window->getRootFolderPath()+qmlPath),
+                                                                         compilationMode);
     if (component->isLoading())
     {
         QObject::connect(component, SIGNAL(statusChanged(QQmlComponent::Status)),
@@ -51,7 +165,7 @@ void AppObjectHandler::loadComponent(QString qmlPath,
     }
     if (!component)
     {
-        qWarning() << Q_FUNC_INFO << ": The component "+qmlPath+" was not found!";
+        appCWarning(lcAppComponents, qmlPath) << Q_FUNC_INFO << ": The component "+qmlPath+" was not found!";
     }
     m_components[qmlPath] = component;
 }
@@ -60,14 +174,24 @@ void AppObjectHandler::unloadComponent(QString qmlPath)
 {
     if (!m_components.contains(qmlPath))
     {
-        qWarning() << Q_FUNC_INFO << ": The component "+qmlPath+" is not loaded!";
+        appCWarning(lcAppComponents, qmlPath) << Q_FUNC_INFO << ": The component "+qmlPath+" is not loaded!";
         return;
     }
-    delete m_components[qmlPath];
-    m_components.remove(qmlPath);
+    // The registry keeps the component alive while items created from it exist
+    QQmlComponent* component = m_components.take(qmlPath);
+    QObject::disconnect(component, 0, this, 0);
+    AppComponentRegistry::instance()->release(component);
+    m_window->maintenance()->requestMaintenance();
 }
 
 QQuickItem * AppObjectHandler::getQuickItemFromComponent(QString qmlPath)
+{
+    return getQuickItemFromComponent(qmlPath, QVariantMap());
+}
+
+QQuickItem* AppObjectHandler::getQuickItemFromComponent(QString qmlPath,
+                                                        const QVariantMap& initialProperties,
+                                                        QQuickItem* parentItem)
 {
     // Create the visual enemy and place it into the correct layer
     if (m_components.contains(qmlPath))
@@ -76,47 +200,906 @@ QQuickItem * AppObjectHandler::getQuickItemFromComponent(QString qmlPath)
         QQuickItem *quickItem = 0;
         if (component == 0)
         {
-            qWarning() << "AppObject::getQuickItemFromComponent(): The component "+qmlPath+" is null!";
+            appCWarning(lcAppComponents, qmlPath) << "AppObject::getQuickItemFromComponent(): The component "+qmlPath+" is null!";
         }
         else
         {
-            while (component->isLoading())
-            {
-                QCoreApplication::processEvents(QEventLoop::AllEvents, 15);
-            }
-            QQmlIncubator incubator;
-            component->create(incubator);
-            while (!incubator.isReady()) {
-                QCoreApplication::processEvents(QEventLoop::AllEvents, 15);
-            }
-            quickItem = qobject_cast<QQuickItem *>(incubator.object());
+            quickItem = createFromComponent(component, initialProperties, parentItem);
         }
         return quickItem;
     }
     else
     {
-        qDebug() << "AppObject::getQuickItemFromComponent(): The component "+qmlPath+" is not preloaded, loading";
+        qCDebug(lcAppComponents) << "AppObject::getQuickItemFromComponent(): The component "+qmlPath+" is not preloaded, loading";
         loadComponent(qmlPath,QQmlComponent::PreferSynchronous);
         QQuickItem *quickItem = 0;
-        quickItem = getQuickItemFromComponent(qmlPath);
+        quickItem = getQuickItemFromComponent(qmlPath, initialProperties, parentItem);
         return quickItem;
     }
 }
 
-void AppObjectHandler::componentStatusChanged(QQmlComponent::Status status)
+void AppObjectHandler::registerPrefab(const QString& name,
+                                      const AppObjectPrefab& prefab,
+                                      QQmlComponent::CompilationMode compilationMode)
+{
+    m_prefabs[name] = prefab;
+    QStringList paths = prefab.componentPaths();
+    for (auto iter = paths.constBegin(); iter != paths.constEnd(); ++iter)
+    {
+        if (!m_components.contains(*iter))
+        {
+            loadComponent(*iter, compilationMode);
+        }
+    }
+}
+
+bool AppObjectHandler::loadPrefab(const QString& name, const QString& jsonPath)
+{
+    QFile file(m_window->properPath(m_window->getRootFolderPath()+jsonPath));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        appCWarning(lcAppObjects, jsonPath) << Q_FUNC_INFO << ": The prefab "+jsonPath+" cannot be opened!";
+        return false;
+    }
+    QString error;
+    AppObjectPrefab prefab = AppObjectPrefab::fromJson(file.readAll(), &error);
+    if (prefab.isEmpty())
+    {
+        appCWarning(lcAppObjects, jsonPath) << Q_FUNC_INFO << ": The prefab "+jsonPath+" is invalid: "+error;
+        return false;
+    }
+    registerPrefab(name, prefab);
+    return true;
+}
+
+void AppObjectHandler::unregisterPrefab(const QString& name)
+{
+    m_prefabs.remove(name);
+}
+
+QList<AppObject*> AppObjectHandler::spawn(const QString& prefab,
+                                          int count,
+                                          const QList<QVariantMap>& initialStates)
+{
+    QList<AppObject*> objects;
+    if (!m_prefabs.contains(prefab))
+    {
+        appCWarning(lcAppObjects, prefab) << Q_FUNC_INFO << ": The prefab "+prefab+" is not registered!";
+        return objects;
+    }
+    const QList<AppObjectPrefab::Item>& items = m_prefabs[prefab].items();
+
+    // The objects of a recorded spawn are replayed by the spawn
+    AppRecorder* recorder = m_window->recorder();
+    if (recorder)
+    {
+        recorder->recordSpawn(this, prefab, count, initialStates);
+    }
+    AppRecorder::Scope recording(recorder);
+
+    // Resolve the layers and components once for the whole batch
+    QVector<QQuickItem*> layers;
+    QVector<QQmlComponent*> components;
+    for (auto iter = items.constBegin(); iter != items.constEnd() && !m_virtualized; ++iter)
+    {
+        QQuickItem* layer = qobject_cast<QQuickItem*>(m_window->getByObjectName(iter->layer));
+        if (!layer)
+        {
+            appCWarning(lcAppLayers, iter->layer) << Q_FUNC_INFO << ": The layer "+iter->layer+" cannot be found!";
+        }
+        layers.append(layer);
+        if (!m_components.contains(iter->qmlPath))
+        {
+            loadComponent(iter->qmlPath, QQmlComponent::PreferSynchronous);
+        }
+        components.append(m_components.value(iter->qmlPath));
+    }
+
+    objects.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        QVariantMap state = initialStates.value(i);
+        AppObject* object = createObject();
+        object->m_x = state.value("x", object->m_x).toFloat();
+        object->m_y = state.value("y", object->m_y).toFloat();
+        object->m_z = state.value("z", object->m_z).toInt();
+        object->m_width = state.value("width", object->m_width).toFloat();
+        object->m_height = state.value("height", object->m_height).toFloat();
+        object->m_rotation = state.value("rotation", object->m_rotation).toFloat();
+        object->m_centerX = object->m_x+object->m_width/2.0;
+        object->m_centerY = object->m_y+object->m_height/2.0;
+        QVariantMap geometry = object->initialGeometry();
+
+        for (int j = 0; j < items.size(); ++j)
+        {
+            const AppObjectPrefab::Item& item = items[j];
+            QVariantMap properties = item.properties;
+            for (auto iter = geometry.constBegin(); iter != geometry.constEnd(); ++iter)
+            {
+                properties[iter.key()] = iter.value();
+            }
+            for (auto iter = state.constBegin(); iter != state.constEnd(); ++iter)
+            {
+                int dot = iter.key().indexOf('.');
+                if (dot < 0)
+                {
+                    if (!geometry.contains(iter.key()))
+                    {
+                        properties[iter.key()] = iter.value();
+                    }
+                }
+                else if (iter.key().leftRef(dot) == item.name)
+                {
+                    properties[iter.key().mid(dot+1)] = iter.value();
+                }
+            }
+            if (m_virtualized)
+            {
+                object->insertItem(item.name, 0, item.qmlPath, item.layer, &properties);
+                continue;
+            }
+            QQuickItem* quickItem = 0;
+            if (components[j])
+            {
+                quickItem = createFromComponent(components[j], properties, layers[j]);
+            }
+            if (quickItem == 0)
+            {
+                appCWarning(lcAppComponents, item.qmlPath) << Q_FUNC_INFO << ": The component "+item.qmlPath+" cannot be created!";
+            }
+            else
+            {
+                object->insertItem(item.name, quickItem, item.qmlPath, item.layer);
+            }
+        }
+        objects.append(object);
+    }
+    scheduleViewportUpdate();
+    return objects;
+}
+
+void AppObjectHandler::applyGeometry(const GeometryUpdate* updates, int count)
+{
+    m_window->markActive();
+    if (AppRecorder* recorder = m_window->recorder())
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            recorder->recordGeometry(updates[i].object, AppRecorder::X, updates[i].x);
+            recorder->recordGeometry(updates[i].object, AppRecorder::Y, updates[i].y);
+            recorder->recordGeometry(updates[i].object, AppRecorder::Rotation, updates[i].rotation);
+        }
+    }
+    QVector<BulkEntry> entries;
+    entries.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        AppObject* object = updates[i].object;
+        object->m_x = updates[i].x;
+        object->m_y = updates[i].y;
+        object->m_rotation = updates[i].rotation;
+        object->m_centerX = object->m_x+object->m_width/2.0;
+        object->m_centerY = object->m_y+object->m_height/2.0;
+        if (object->hasVirtualItems())
+        {
+            scheduleViewportUpdate();
+        }
+        for (auto iter = object->m_items.constBegin(); iter != object->m_items.constEnd(); ++iter)
+        {
+            if (iter->quickItem)
+            {
+                BulkEntry entry = {iter->quickItem, iter->quickItem->parentItem(), 0, 0, i};
+                entries.append(entry);
+            }
+        }
+    }
+    std::sort(entries.begin(), entries.end(), bulkEntryLessThan);
+    for (auto iter = entries.constBegin(); iter != entries.constEnd(); ++iter)
+    {
+        const GeometryUpdate& update = updates[iter->update];
+        iter->item->setX(update.x);
+        iter->item->setY(update.y);
+        iter->item->setRotation(update.rotation);
+    }
+}
+
+void AppObjectHandler::applyGeometry(const QVector<GeometryUpdate>& updates)
+{
+    applyGeometry(updates.constData(), updates.size());
+}
+
+void AppObjectHandler::applyProperties(const PropertyUpdate* updates, int count)
+{
+    m_window->markActive();
+    if (AppRecorder* recorder = m_window->recorder())
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            if (updates[i].target.isEmpty())
+            {
+                recorder->recordProperties(updates[i].object, updates[i].property, updates[i].value);
+            }
+            else
+            {
+                recorder->recordProperty(updates[i].object, updates[i].target,
+                                         updates[i].property, updates[i].value);
+            }
+        }
+    }
+    QVector<BulkEntry> entries;
+    entries.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        const PropertyUpdate& update = updates[i];
+        if (update.target.isEmpty())
+        {
+            for (auto iter = update.object->m_items.begin(); iter != update.object->m_items.end(); ++iter)
+            {
+                if (iter->isVirtual)
+                {
+                    iter->state[update.property] = update.value;
+                }
+                if (iter->quickItem)
+                {
+                    BulkEntry entry = {iter->quickItem, iter->quickItem->parentItem(),
+                                       iter->quickItem->metaObject()->className(), &iter->qmlPath, i};
+                    entries.append(entry);
+                }
+            }
+        }
+        else
+        {
+            int index = update.object->indexOfItem(update.target);
+            if (index >= 0)
+            {
+                AppObject::Item& item = update.object->m_items[index];
+                if (item.isVirtual)
+                {
+                    item.state[update.property] = update.value;
+                }
+                if (item.quickItem)
+                {
+                    BulkEntry entry = {item.quickItem, item.quickItem->parentItem(),
+                                       item.quickItem->metaObject()->className(), &item.qmlPath, i};
+                    entries.append(entry);
+                }
+            }
+            else
+            {
+                appCWarning(lcAppObjects, update.target) << Q_FUNC_INFO << ": The target "+update.target+" was not found!";
+            }
+        }
+    }
+    std::sort(entries.begin(), entries.end(), bulkEntryLessThan);
+
+    // The property indices are shared by all the instances of a component, so
+    // the names are resolved from the table of the component
+    const char* currentType = 0;
+    const QHash<QByteArray, int>* properties = 0;
+    for (auto iter = entries.constBegin(); iter != entries.constEnd(); ++iter)
+    {
+        const PropertyUpdate& update = updates[iter->update];
+        int index = update.index;
+        if (index < 0)
+        {
+            if (iter->type != currentType)
+            {
+                currentType = iter->type;
+                properties = iter->qmlPath->isEmpty() ? 0 : &componentProperties(*iter->qmlPath, iter->item->metaObject());
+            }
+            index = properties ? properties->value(QByteArray::fromRawData(update.property, qstrlen(update.property)), -1)
+                               : iter->item->metaObject()->indexOfProperty(update.property);
+        }
+        Q_ASSERT(index < 0 || qstrcmp(iter->item->metaObject()->property(index).name(), update.property) == 0);
+        if (index < 0)
+        {
+            iter->item->setProperty(update.property, update.value);
+            appCWarning(lcAppObjects, QString::fromUtf8(update.property)) << Q_FUNC_INFO << ": The property " << update.property << " was not found but was created!";
+        }
+        else
+        {
+            iter->item->metaObject()->property(index).write(iter->item, update.value);
+        }
+    }
+}
+
+void AppObjectHandler::applyProperties(const QVector<PropertyUpdate>& updates)
+{
+    applyProperties(updates.constData(), updates.size());
+}
+
+int AppObjectHandler::resolveProperty(const QString& qmlPath, const char* name)
+{
+    return componentProperties(qmlPath).value(QByteArray::fromRawData(name, qstrlen(name)), -1);
+}
+
+QByteArray AppObjectHandler::saveSnapshot(const QList<QByteArray>& properties) const
+{
+    // The names are written once, before the objects that refer to them
+    QStringList names;
+    QHash<QString, quint16> indices;
+    auto intern = [&names, &indices](const QString& name) -> quint16
+    {
+        auto iter = indices.constFind(name);
+        if (iter != indices.constEnd())
+        {
+            return *iter;
+        }
+        names.append(name);
+        return indices[name] = quint16(names.size()-1);
+    };
+    QVector<quint16> propertyNames;
+    for (auto iter = properties.constBegin(); iter != properties.constEnd(); ++iter)
+    {
+        propertyNames.append(intern(QString::fromUtf8(*iter)));
+    }
+
+    QByteArray body;
+    QDataStream stream(&body, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_9);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    stream << quint32(m_objects.size());
+    for (auto iter = m_objects.constBegin(); iter != m_objects.constEnd(); ++iter)
+    {
+        const AppObject* object = *iter;
+        stream << object->m_x << object->m_y << object->m_width << object->m_height
+               << object->m_rotation << qint32(object->m_z);
+        quint16 itemCount = 0;
+        for (auto item = object->m_items.constBegin(); item != object->m_items.constEnd(); ++item)
+        {
+            itemCount += item->qmlPath.isEmpty() ? 0 : 1;
+        }
+        stream << itemCount;
+        for (auto item = object->m_items.constBegin(); item != object->m_items.constEnd(); ++item)
+        {
+            if (item->qmlPath.isEmpty())
+            {
+                continue;
+            }
+            stream << intern(item->qmlPath) << intern(item->name) << intern(item->layer);
+            // The live item has the current values, a released one its state
+            QVector<QPair<quint16, QVariant> > values;
+            for (int i = 0; i < properties.size(); ++i)
+            {
+                QVariant value = item->quickItem ? item->quickItem->property(properties[i].constData())
+                                                 : item->isVirtual ? item->state.value(names[propertyNames[i]])
+                                                               : QVariant();
+                if (value.isValid())
+                {
+                    values.append(qMakePair(propertyNames[i], value));
+                }
+            }
+            stream << quint16(values.size());
+            for (auto value = values.constBegin(); value != values.constEnd(); ++value)
+            {
+                stream << value->first << value->second;
+            }
+        }
+    }
+    if (names.size() > 0xffff)
+    {
+        appCWarning(lcAppObjects, QString()) << Q_FUNC_INFO << ": Too many names for a snapshot!";
+        return QByteArray();
+    }
+
+    QByteArray snapshot(SNAPSHOT_MAGIC);
+    snapshot.append(char(SNAPSHOT_VERSION));
+    QDataStream header(&snapshot, QIODevice::WriteOnly | QIODevice::Append);
+    header.setVersion(QDataStream::Qt_5_9);
+    header << names;
+    snapshot.append(body);
+    return snapshot;
+}
+
+bool AppObjectHandler::restoreSnapshot(const QByteArray& snapshot, int batchSize)
+{
+    if (isRestoring())
+    {
+        appCWarning(lcAppObjects, QString()) << Q_FUNC_INFO << ": A snapshot is already being restored!";
+        return false;
+    }
+    if (!snapshot.startsWith(SNAPSHOT_MAGIC) || snapshot.size() < 5 || quint8(snapshot[4]) != SNAPSHOT_VERSION)
+    {
+        appCWarning(lcAppObjects, QString()) << Q_FUNC_INFO << ": Not a snapshot of a supported version!";
+        return false;
+    }
+    m_restoreClock.start();
+    QDataStream stream(snapshot.mid(5));
+    stream.setVersion(QDataStream::Qt_5_9);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    QStringList names;
+    quint32 objectCount = 0;
+    stream >> names >> objectCount;
+    QVector<SavedObject> objects;
+    QSet<QString> components;
+    for (quint32 i = 0; i < objectCount && stream.status() == QDataStream::Ok; ++i)
+    {
+        SavedObject object;
+        qint32 z = 0;
+        quint16 itemCount = 0;
+        stream >> object.x >> object.y >> object.width >> object.height >> object.rotation >> z >> itemCount;
+        object.z = z;
+        for (int j = 0; j < itemCount && stream.status() == QDataStream::Ok; ++j)
+        {
+            SavedItem item;
+            quint16 qmlPath = 0, name = 0, layer = 0, valueCount = 0;
+            stream >> qmlPath >> name >> layer >> valueCount;
+            item.qmlPath = names.value(qmlPath);
+            item.name = names.value(name);
+            item.layer = names.value(layer);
+            for (int k = 0; k < valueCount && stream.status() == QDataStream::Ok; ++k)
+            {
+                quint16 property = 0;
+                QVariant value;
+                stream >> property >> value;
+                item.properties[names.value(property)] = value;
+            }
+            components.insert(item.qmlPath);
+            object.items.append(item);
+        }
+        objects.append(object);
+    }
+    if (stream.status() != QDataStream::Ok)
+    {
+        appCWarning(lcAppObjects, QString()) << Q_FUNC_INFO << ": The snapshot is corrupt or truncated!";
+        return false;
+    }
+
+    if (objects.isEmpty())
+    {
+        m_lastRestoreNsec = m_restoreClock.nsecsElapsed();
+        emit snapshotRestored(0, m_lastRestoreNsec);
+        return true;
+    }
+
+    // All the components are loaded together before any object is created
+    for (auto iter = components.constBegin(); iter != components.constEnd(); ++iter)
+    {
+        if (!m_components.contains(*iter))
+        {
+            loadComponent(*iter, QQmlComponent::Asynchronous);
+        }
+    }
+    m_restoreQueue = objects;
+    m_restoreComponents = components.values();
+    m_restoreNext = 0;
+    m_restoreBatchSize = qMax(1, batchSize);
+    QMetaObject::invokeMethod(this, "restoreBatch", Qt::QueuedConnection);
+    return true;
+}
+
+void AppObjectHandler::setVirtualized(bool virtualized)
+{
+    m_virtualized = virtualized;
+    if (m_virtualized)
+    {
+        scheduleViewportUpdate();
+    }
+    else
+    {
+        for (auto iter = m_objects.constBegin(); iter != m_objects.constEnd(); ++iter)
+        {
+            if (!(*iter)->m_materialized)
+            {
+                (*iter)->materialize();
+            }
+        }
+    }
+}
+
+void AppObjectHandler::setViewport(const QRectF& viewport, qreal margin)
+{
+    m_viewport = viewport;
+    m_viewportMargin = margin;
+    scheduleViewportUpdate();
+}
+
+QRectF AppObjectHandler::getViewport() const
+{
+    if (m_viewport.isNull())
+    {
+        return QRectF(0, 0, m_window->width(), m_window->height());
+    }
+    return m_viewport;
+}
+
+void AppObjectHandler::setPoolCapacity(int capacity)
+{
+    m_poolCapacity = capacity;
+    for (auto iter = m_pool.begin(); iter != m_pool.end(); ++iter)
+    {
+        while (iter->size() > m_poolCapacity)
+        {
+            iter->takeLast()->deleteLater();
+        }
+    }
+}
+
+void AppObjectHandler::trimPool()
+{
+    for (auto iter = m_pool.begin(); iter != m_pool.end(); ++iter)
+    {
+        qDeleteAll(*iter);
+    }
+    m_pool.clear();
+}
+
+int AppObjectHandler::pooledItemCount() const
+{
+    int count = 0;
+    for (auto iter = m_pool.constBegin(); iter != m_pool.constEnd(); ++iter)
+    {
+        count += iter->size();
+    }
+    return count;
+}
+
+QVector<QQuickItem*> AppObjectHandler::liveItems() const
+{
+    QVector<QQuickItem*> items;
+    for (auto iter = m_objects.constBegin(); iter != m_objects.constEnd(); ++iter)
+    {
+        const AppObject* object = *iter;
+        for (int i = 0; i < object->m_items.size(); ++i)
+        {
+            if (object->m_items[i].quickItem)
+            {
+                items.append(object->m_items[i].quickItem);
+            }
+        }
+    }
+    return items;
+}
+
+QVector<QQuickItem*> AppObjectHandler::cachedLayers() const
+{
+    QVector<QQuickItem*> layers;
+    for (auto iter = m_layers.constBegin(); iter != m_layers.constEnd(); ++iter)
+    {
+        if (!iter->isNull())
+        {
+            layers.append(iter->data());
+        }
+    }
+    return layers;
+}
+
+int AppObjectHandler::liveItemCount() const
+{
+    int count = 0;
+    for (auto iter = m_objects.constBegin(); iter != m_objects.constEnd(); ++iter)
+    {
+        const AppObject* object = *iter;
+        for (int i = 0; i < object->m_items.size(); ++i)
+        {
+            if (object->m_items[i].quickItem)
+            {
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+/*******************************************************************************
+ * PROTECTED FUNCTIONS
+ */
+AppObject* AppObjectHandler::createObject()
+{
+    return new (this) AppObject(m_window, this);
+}
+
+QQuickItem* AppObjectHandler::createFromComponent(QQmlComponent* component,
+                                                  const QVariantMap& initialProperties,
+                                                  QQuickItem* parentItem)
+{
+    while (component->isLoading())
+    {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 15);
+    }
+    AppItemIncubator incubator(initialProperties, parentItem);
+    // Created in the context of the window, where "app" refers to it
+    QQmlContext* context = component->engine() == m_window->engine() ? m_window->context() : 0;
+    component->create(incubator, context);
+    while (incubator.isLoading()) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 15);
+    }
+    QQuickItem* quickItem = qobject_cast<QQuickItem *>(incubator.object());
+    AppComponentRegistry::instance()->trackInstance(component, quickItem);
+    return quickItem;
+}
+
+void AppObjectHandler::registerObject(AppObject* object)
+{
+    object->m_handlerIndex = m_objects.size();
+    m_objects.append(object);
+    if (m_window && m_window->recorder())
+    {
+        m_window->recorder()->recordCreate(this, object);
+    }
+}
+
+void AppObjectHandler::unregisterObject(AppObject* object)
+{
+    if (m_window && m_window->recorder())
+    {
+        m_window->recorder()->recordDestroy(object);
+    }
+    int index = object->m_handlerIndex;
+    if (index < 0 || index >= m_objects.size() || m_objects[index] != object)
+    {
+        return;
+    }
+    // Swap with the last object so that the removal is constant time
+    AppObject* last = m_objects.last();
+    m_objects[index] = last;
+    last->m_handlerIndex = index;
+    m_objects.removeLast();
+    object->m_handlerIndex = -1;
+}
+
+void AppObjectHandler::scheduleViewportUpdate()
 {
-    QDebug deb = qDebug();
-    deb << "AppObjectHandler: Asynchronous component loading finished, status is now:";
-    if (status == QQmlComponent::Ready)
+    if (m_virtualized && !m_viewportUpdatePending)
     {
-        deb << "Ready";
+        m_viewportUpdatePending = true;
+        QMetaObject::invokeMethod(this, "updateViewport", Qt::QueuedConnection);
     }
-    else if (status == QQmlComponent::Error)
+}
+
+QQuickItem* AppObjectHandler::acquireItem(const QString& qmlPath,
+                                          const QString& layer,
+                                          const QVariantMap& state)
+{
+    QQuickItem* itemLayer = findLayer(layer);
+    QList<QQuickItem*>& pool = m_pool[qmlPath];
+    if (pool.isEmpty())
     {
-        deb << "Error";
+        return getQuickItemFromComponent(qmlPath, state, itemLayer);
+    }
+    // The state is applied before the item enters the scene again
+    QQuickItem* item = pool.takeLast();
+    for (auto iter = state.constBegin(); iter != state.constEnd(); ++iter)
+    {
+        item->setProperty(iter.key().toUtf8().constData(), iter.value());
+    }
+    item->setParent(itemLayer);
+    item->setParentItem(itemLayer);
+    return item;
+}
+
+void AppObjectHandler::releaseItem(const QString& qmlPath, QQuickItem* item, const QVariantMap& state)
+{
+    item->setParentItem(0);
+    QList<QQuickItem*>& pool = m_pool[qmlPath];
+    if (pool.size() < m_poolCapacity)
+    {
+        // Everything the object set is undone, the next one applies its own
+        static const char* const geometry[] = {"x", "y", "z", "rotation", "width", "height"};
+        const QVariantMap& defaults = componentDefaults(qmlPath);
+        for (auto iter = state.constBegin(); iter != state.constEnd(); ++iter)
+        {
+            // A property missing from the defaults was created dynamically,
+            // and an invalid value removes it
+            item->setProperty(iter.key().toUtf8().constData(), defaults.value(iter.key()));
+        }
+        for (const char* property : geometry)
+        {
+            item->setProperty(property, defaults.value(property));
+        }
+        item->setParent(this);
+        pool.append(item);
     }
     else
     {
-        deb << "Loading or Null";
+        item->deleteLater();
+    }
+}
+
+const QVariantMap& AppObjectHandler::componentDefaults(const QString& qmlPath)
+{
+    auto iter = m_poolDefaults.find(qmlPath);
+    if (iter != m_poolDefaults.end())
+    {
+        return *iter;
+    }
+    QVariantMap& defaults = m_poolDefaults[qmlPath];
+    QQuickItem* prototype = getQuickItemFromComponent(qmlPath);
+    if (prototype)
+    {
+        const QMetaObject* metaObject = prototype->metaObject();
+        for (int i = 0; i < metaObject->propertyCount(); ++i)
+        {
+            QMetaProperty property = metaObject->property(i);
+            if (property.isWritable())
+            {
+                defaults[property.name()] = property.read(prototype);
+            }
+        }
+        delete prototype;
+    }
+    return defaults;
+}
+
+const QHash<QByteArray, int>& AppObjectHandler::componentProperties(const QString& qmlPath,
+                                                                     const QMetaObject* metaObject)
+{
+    auto iter = m_propertyIndices.find(qmlPath);
+    if (iter != m_propertyIndices.end())
+    {
+        return *iter;
+    }
+    QQuickItem* prototype = metaObject ? 0 : getQuickItemFromComponent(qmlPath);
+    if (prototype)
+    {
+        metaObject = prototype->metaObject();
+    }
+    if (!metaObject)
+    {
+        // Not remembered, the component may load later
+        static const QHash<QByteArray, int> none;
+        return none;
+    }
+    QHash<QByteArray, int>& indices = m_propertyIndices[qmlPath];
+    for (int i = 0; i < metaObject->propertyCount(); ++i)
+    {
+        indices.insert(metaObject->property(i).name(), i);
+    }
+    delete prototype;
+    return indices;
+}
+
+QQuickItem* AppObjectHandler::findLayer(const QString& layer)
+{
+    QPointer<QQuickItem>& cached = m_layers[layer];
+    if (cached.isNull())
+    {
+        cached = qobject_cast<QQuickItem*>(m_window->getByObjectName(layer));
+        if (cached.isNull())
+        {
+            appCWarning(lcAppLayers, layer) << Q_FUNC_INFO << ": The layer "+layer+" cannot be found!";
+        }
     }
+    return cached.data();
+}
+
+/*******************************************************************************
+ * SLOTS
+ */
+void AppObjectHandler::componentStatusChanged(QQmlComponent::Status status)
+{
+    qCDebug(lcAppComponents) << "AppObjectHandler: Asynchronous component loading finished, status is now:"
+                             << (status == QQmlComponent::Ready ? "Ready"
+                                : status == QQmlComponent::Error ? "Error" : "Loading or Null");
+}
+
+void AppObjectHandler::updateViewport()
+{
+    m_viewportUpdatePending = false;
+    if (!m_virtualized)
+    {
+        return;
+    }
+    QRectF area = getViewport().adjusted(-m_viewportMargin, -m_viewportMargin,
+                                         m_viewportMargin, m_viewportMargin);
+    // Release before acquiring, so that the released items can be reused
+    QVector<AppObject*> entered;
+    for (auto iter = m_objects.constBegin(); iter != m_objects.constEnd(); ++iter)
+    {
+        AppObject* object = *iter;
+        if (!object->hasVirtualItems())
+        {
+            continue;
+        }
+        // Objects without a size are treated as points
+        QRectF bounds(object->m_x, object->m_y,
+                      qMax(object->m_width, 1.0f), qMax(object->m_height, 1.0f));
+        bool inside = area.intersects(bounds);
+        if (inside && !object->m_materialized)
+        {
+            entered.append(object);
+        }
+        else if (!inside && object->m_materialized)
+        {
+            object->dematerialize();
+        }
+    }
+    for (auto iter = entered.constBegin(); iter != entered.constEnd(); ++iter)
+    {
+        (*iter)->materialize();
+    }
+}
+
+/*******************************************************************************
+ * PRIVATE SLOTS
+ */
+void AppObjectHandler::restoreBatch()
+{
+    if (m_restoreQueue.isEmpty())
+    {
+        return;
+    }
+    for (auto iter = m_restoreComponents.constBegin(); iter != m_restoreComponents.constEnd(); ++iter)
+    {
+        QQmlComponent* component = m_components.value(*iter);
+        if (component && component->isLoading())
+        {
+            QTimer::singleShot(15, this, SLOT(restoreBatch()));
+            return;
+        }
+    }
+
+    // The objects are created in their saved order rather than grouped by
+    // component: items of equal z in a layer stack in creation order, so
+    // grouping would change which one is drawn on top
+    int end = qMin(m_restoreNext+m_restoreBatchSize, m_restoreQueue.size());
+    for (; m_restoreNext < end; ++m_restoreNext)
+    {
+        const SavedObject& saved = m_restoreQueue[m_restoreNext];
+        AppObject* object = createObject();
+        object->m_x = saved.x;
+        object->m_y = saved.y;
+        object->m_z = saved.z;
+        object->m_width = saved.width;
+        object->m_height = saved.height;
+        object->m_rotation = saved.rotation;
+        object->m_centerX = object->m_x+object->m_width/2.0;
+        object->m_centerY = object->m_y+object->m_height/2.0;
+        // The items are recorded with the properties they are created with
+        AppRecorder* recorder = m_window->recorder();
+        if (recorder)
+        {
+            recorder->recordState(object, false);
+        }
+        QVariantMap geometry = object->initialGeometry();
+        for (auto item = saved.items.constBegin(); item != saved.items.constEnd(); ++item)
+        {
+            QVariantMap properties = item->properties;
+            for (auto iter = geometry.constBegin(); iter != geometry.constEnd(); ++iter)
+            {
+                properties[iter.key()] = iter.value();
+            }
+            if (m_virtualized)
+            {
+                object->insertItem(item->name, 0, item->qmlPath, item->layer, &properties);
+                if (recorder)
+                {
+                    recorder->recordAddItem(object, item->qmlPath, item->name, item->layer, properties);
+                }
+                continue;
+            }
+            QQmlComponent* component = m_components.value(item->qmlPath);
+            QQuickItem* quickItem = 0;
+            if (component && component->isReady())
+            {
+                quickItem = createFromComponent(component, properties, findLayer(item->layer));
+            }
+            if (quickItem == 0)
+            {
+                appCWarning(lcAppComponents, item->qmlPath) << Q_FUNC_INFO << ": The component "+item->qmlPath+" cannot be created!";
+            }
+            else
+            {
+                object->insertItem(item->name, quickItem, item->qmlPath, item->layer);
+                if (recorder)
+                {
+                    recorder->recordAddItem(object, item->qmlPath, item->name, item->layer, properties);
+                }
+            }
+        }
+    }
+    m_window->markActive();
+    if (m_restoreNext < m_restoreQueue.size())
+    {
+        QMetaObject::invokeMethod(this, "restoreBatch", Qt::QueuedConnection);
+        return;
+    }
+
+    int count = m_restoreQueue.size();
+    m_restoreQueue.clear();
+    m_restoreComponents.clear();
+    m_restoreNext = 0;
+    scheduleViewportUpdate();
+    m_lastRestoreNsec = m_restoreClock.nsecsElapsed();
+    emit snapshotRestored(count, m_lastRestoreNsec);
 }
@@ -4,7 +4,14 @@
 #include <QObject>
 #include <QQuickItem>
 #include <QQmlComponent>
+#include <QVector>
+#include <QPointer>
+#include <QRectF>
+#include <QElapsedTimer>
+#include "appobjectprefab.hh"
+#include "appobjectpool.hh"
 class AppWindow;
+class AppObject;
 
 ////////////////////////////////////////////////////////////////////////////////
 ///
@@ -19,6 +26,8 @@ class AppWindow;
 class AppObjectHandler : public QObject
 {
     Q_OBJECT
+    friend class AppObject;
+    friend class AppReplayer;
 
 public:
     /***************************************************************************
@@ -33,18 +42,41 @@ public:
      */
     AppObjectHandler(AppWindow* window, QObject* parent=0);
 
-    /** Destructs the preloaded QQmlComponents */
+    /** Releases the preloaded QQmlComponents */
     virtual ~AppObjectHandler();
 
     /***************************************************************************
      * PUBLIC FUNCTIONS
      */
+    /**
+     * Moves the handler and its AppObjects to another window. The items are
+     * reparented to the layers of the same name in the new window. If the
+     * window has another engine, the components are loaded again in it and
+     * the pool is emptied; the existing items keep the context of the old
+     * window.
+     */
+    void setWindow(AppWindow* window);
+    AppWindow* getWindow() const {return m_window;}
+
     /**
      * Returns a pointer to a newly created QQuickItem. This pointer has no
      * owner or visual parent.
      */
     QQuickItem* getQuickItemFromComponent(QString qmlPath);
 
+    /**
+     * Returns a pointer to a newly created QQuickItem whose visual parent and
+     * initial property values are set before the component is completed, so
+     * that bindings and change handlers are evaluated only once.
+     * @param qmlPath The path to the component of the item
+     * @param initialProperties The property values the item is created with,
+     * e.g. "x", "y", "width", "height" and "rotation"
+     * @param parentItem The possible visual parent (and owner) of the item
+     */
+    QQuickItem* getQuickItemFromComponent(QString qmlPath,
+                                          const QVariantMap& initialProperties,
+                                          QQuickItem* parentItem=0);
+
     /**
      * Loads a QQmlComponent with the given compilation mode (Asynchronous,
      * PreferSynchronous).
@@ -55,22 +87,308 @@ public:
                        QQmlComponent::CompilationMode compilationMode=QQmlComponent::Asynchronous,
                        QQmlEngine* engine=0);
     /**
-      * Unloads (deletes) the preloaded component.
+      * Unloads the preloaded component. The compiled component is shared
+      * through the AppComponentRegistry and is released only when it is not
+      * used by other handlers, views or live items.
       */
     void unloadComponent(QString qmlPath);
 
+    /***************************************************************************
+     * PREFABS
+     */
+    /**
+     * Registers a prefab under the given name and starts preloading the
+     * components it uses.
+     * @param name The name the prefab is spawned with
+     * @param prefab The prefab
+     * @param compilationMode The mode the components are preloaded with
+     */
+    void registerPrefab(const QString& name,
+                        const AppObjectPrefab& prefab,
+                        QQmlComponent::CompilationMode compilationMode=QQmlComponent::Asynchronous);
+
+    /**
+     * Loads a prefab from a JSON file and registers it.
+     * @param name The name the prefab is spawned with
+     * @param jsonPath The path to the JSON file, relative to the root folder
+     * @return True if the prefab was loaded
+     */
+    bool loadPrefab(const QString& name, const QString& jsonPath);
+
+    /** Removes a registered prefab. The preloaded components are kept. */
+    void unregisterPrefab(const QString& name);
+
+    /**
+     * Creates AppObjects from a registered prefab. The layers and components
+     * are resolved once for the whole batch.
+     * @param prefab The name of the registered prefab
+     * @param count The number of objects that are created
+     * @param initialStates Optional initial state of each object. The keys
+     * "x", "y", "z", "width", "height" and "rotation" set the geometry of the
+     * object, keys of the form "item.property" set a property of a single item
+     * and other keys set a property of all the items.
+     * @return The created objects, owned by this handler
+     */
+    QList<AppObject*> spawn(const QString& prefab,
+                            int count,
+                            const QList<QVariantMap>& initialStates=QList<QVariantMap>());
+
+    /***************************************************************************
+     * VIRTUALIZATION
+     */
+    /**
+     * In the virtualized mode the AppObjects of this handler keep their state
+     * in C++ and their QQuickItems exist only while the objects are inside the
+     * expanded viewport. The items are taken from and returned to a pool of
+     * each component, and the state of the object is re-applied when the items
+     * are acquired. Only the items added after enabling the mode with
+     * AppObject::addQuickItem() or spawn() are virtualized.
+     */
+    void setVirtualized(bool virtualized);
+    bool isVirtualized() const {return m_virtualized;}
+
+    /**
+     * Sets the visible area in the coordinates of the layers. Defaults to the
+     * area of the window.
+     * @param viewport The visible area
+     * @param margin How far outside the viewport the items are kept alive
+     */
+    void setViewport(const QRectF& viewport, qreal margin=0);
+    QRectF getViewport() const;
+
+    /** Sets the maximum number of released items kept per component. */
+    void setPoolCapacity(int capacity);
+
+    /** Deletes all the pooled items. */
+    void trimPool();
+
+    /** Returns the number of released items in the pools. */
+    int pooledItemCount() const;
+
+    /** Returns the number of created items of the AppObjects. */
+    int liveItemCount() const;
+
+    /** Returns the created items of the AppObjects. */
+    QVector<QQuickItem*> liveItems() const;
+
+    /** Returns the layers the handler has placed items into, which exist. */
+    QVector<QQuickItem*> cachedLayers() const;
+
+    /** Returns the AppObjects of this handler. */
+    const QVector<AppObject*>& objects() const {return m_objects;}
+
+    /***************************************************************************
+     * SNAPSHOTS
+     */
+    /**
+     * Serializes the AppObjects into a compact versioned binary snapshot: the
+     * geometry of each object and the component, name and layer of its items
+     * with the values of the given properties. The names are stored once.
+     * Items given with AppObject::setQuickItem() have no component and are
+     * not saved.
+     * @param properties The properties of the items that are saved
+     */
+    QByteArray saveSnapshot(const QList<QByteArray>& properties=QList<QByteArray>()) const;
+
+    /**
+     * Recreates the AppObjects of a snapshot, e.g. when the app is resumed.
+     * The components of the snapshot are preloaded first, and the objects are
+     * then created with their saved state as the initial properties of the
+     * items, batchSize objects per pass of the event loop so that frames keep
+     * being rendered. snapshotRestored() is emitted when all are created.
+     * @return False if the snapshot is invalid or a restore is running
+     */
+    bool restoreSnapshot(const QByteArray& snapshot, int batchSize=64);
+
+    bool isRestoring() const {return !m_restoreQueue.isEmpty();}
+
+    /** Returns the duration of the last completed restore in nanoseconds. */
+    qint64 getLastRestoreDuration() const {return m_lastRestoreNsec;}
+
+    /***************************************************************************
+     * BULK MUTATION
+     */
+    /** A packed geometry update for a single AppObject. */
+    struct GeometryUpdate
+    {
+        AppObject* object;
+        float x;
+        float y;
+        float rotation;
+    };
+
+    /** A packed property update for a single AppObject. */
+    struct PropertyUpdate
+    {
+        PropertyUpdate() : object(0), property(0), index(-1) {}
+        PropertyUpdate(AppObject* object,
+                       const QString& target,
+                       const char* property,
+                       const QVariant& value,
+                       int index=-1)
+            : object(object), target(target), property(property), value(value), index(index) {}
+
+        AppObject* object;
+        QString target;         ///< Name of the QQuickItem, empty for all the items of the object
+        const char* property;
+        QVariant value;
+        int index;              ///< From resolveProperty() for the component of the items, -1 to look the name up
+    };
+
+    /**
+     * Resolves a property of a component to its meta-property index, which is
+     * the same for all the instances. Cache it in PropertyUpdate::index so the
+     * name is not looked up on every update.
+     * @return The index, or -1 if the component has no such property
+     */
+    int resolveProperty(const QString& qmlPath, const char* name);
+
+    /**
+     * Applies the geometry of several AppObjects in one pass. The QQuickItems
+     * are grouped by layer before they are touched, so each layer's children
+     * are updated together.
+     * @param updates Pointer to the first update in a packed array
+     * @param count Number of updates in the array
+     */
+    void applyGeometry(const GeometryUpdate* updates, int count);
+    void applyGeometry(const QVector<GeometryUpdate>& updates);
+
+    /**
+     * Applies property values to several AppObjects in one pass. The
+     * QQuickItems are grouped by layer and component, and the values are
+     * written through the meta-properties. The names of the updates without
+     * an index are resolved once per component and remembered.
+     * @param updates Pointer to the first update in a packed array
+     * @param count Number of updates in the array
+     */
+    void applyProperties(const PropertyUpdate* updates, int count);
+    void applyProperties(const QVector<PropertyUpdate>& updates);
+
+signals:
+    /***************************************************************************
+     * SIGNALS
+     */
+    /** Emitted when a restore is done, with the time from restoreSnapshot(). */
+    void snapshotRestored(int objectCount, qint64 durationNsec);
+
 public slots:
     /***************************************************************************
      * SLOTS
      */
     void componentStatusChanged(QQmlComponent::Status status);
 
+    /**
+     * Acquires the items of the objects that entered the expanded viewport and
+     * releases the items of the objects that left it.
+     */
+    void updateViewport();
+
+private slots:
+    /***************************************************************************
+     * PRIVATE SLOTS
+     */
+    /** Creates the next batch of the objects being restored. */
+    void restoreBatch();
+
 protected:
+    /***************************************************************************
+     * PROTECTED FUNCTIONS
+     */
+    /**
+     * Creates an empty AppObject for spawn() from the arena of this handler.
+     * Override this to spawn objects of an inheriting AppObject class, e.g.
+     * return new (this) Enemy(m_window, this).
+     */
+    virtual AppObject* createObject();
+
+    /**
+     * Creates a QQuickItem from a loaded component, waiting for the
+     * component and the incubation to finish.
+     */
+    QQuickItem* createFromComponent(QQmlComponent* component,
+                                    const QVariantMap& initialProperties,
+                                    QQuickItem* parentItem);
+
+    /** Called by the AppObjects on construction and destruction. */
+    void registerObject(AppObject* object);
+    void unregisterObject(AppObject* object);
+
+    /** Queues an updateViewport() if the handler is virtualized. */
+    void scheduleViewportUpdate();
+
+    /**
+     * Returns an item of the component from the pool, or creates a new one,
+     * with the given state applied and placed into the layer.
+     */
+    QQuickItem* acquireItem(const QString& qmlPath,
+                            const QString& layer,
+                            const QVariantMap& state);
+
+    /**
+     * Removes the item from the scene and returns it to the pool. The
+     * properties in the state of its object and the geometry are reset to the
+     * defaults of the component, so they do not show on the next object.
+     */
+    void releaseItem(const QString& qmlPath, QQuickItem* item, const QVariantMap& state);
+
+    /** Returns the default property values of the component, read once from
+     * an instance created for that. */
+    const QVariantMap& componentDefaults(const QString& qmlPath);
+
+    /** Returns the meta-property indices of the component by name, read once
+     * from the meta-object of an instance, or of a prototype if null. */
+    const QHash<QByteArray, int>& componentProperties(const QString& qmlPath,
+                                                      const QMetaObject* metaObject=0);
+
+    /** Returns the layer with the given objectName, cached. */
+    QQuickItem* findLayer(const QString& layer);
+
     /***************************************************************************
      * PROTECTED VARIABLES
      */
     AppWindow* m_window;                         ///< The window that shows everything.
-    QHash<QString, QQmlComponent*> m_components; ///< The preloaded QQmlComponents for quickly creating needed QQuickItems
+    QHash<QString, QQmlComponent*> m_components; ///< The preloaded QQmlComponents, referenced from the AppComponentRegistry
+    QHash<QString, AppObjectPrefab> m_prefabs;   ///< The registered prefabs by name
+    QVector<AppObject*> m_objects;               ///< All the AppObjects of this handler
+    bool m_virtualized;                          ///< Whether the items are created only near the viewport
+    bool m_viewportUpdatePending;
+    QRectF m_viewport;                           ///< The visible area, null for the whole window
+    qreal m_viewportMargin;                      ///< Expansion of the viewport on each side
+    int m_poolCapacity;                          ///< Maximum number of pooled items per component
+    QHash<QString, QList<QQuickItem*> > m_pool;  ///< The released items by component
+    QHash<QString, QVariantMap> m_poolDefaults;  ///< Default property values by component, for resetting released items
+    QHash<QString, QHash<QByteArray, int> > m_propertyIndices;   ///< Meta-property indices by component and name
+    QHash<QString, QPointer<QQuickItem> > m_layers;  ///< Cache of the layers by objectName
+    AppObjectPool m_objectPool;                  ///< Arena the AppObjects of this handler can be allocated from
+
+private:
+    /** An item of a snapshot. */
+    struct SavedItem
+    {
+        QString qmlPath;
+        QString name;
+        QString layer;
+        QVariantMap properties;
+    };
+
+    /** An object of a snapshot. */
+    struct SavedObject
+    {
+        float x;
+        float y;
+        float width;
+        float height;
+        float rotation;
+        int z;
+        QVector<SavedItem> items;
+    };
+
+    QVector<SavedObject> m_restoreQueue;         ///< The objects of the snapshot being restored
+    QStringList m_restoreComponents;             ///< The components the restore waits for
+    int m_restoreNext;                           ///< Index of the next object to restore
+    int m_restoreBatchSize;
+    QElapsedTimer m_restoreClock;
+    qint64 m_lastRestoreNsec;
 };
 
 #endif // APPOBJECTHANDLER_HH
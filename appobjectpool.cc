@@ -0,0 +1,93 @@
+#include "appobjectpool.hh"
+#include <new>
+
+namespace
+{
+/** Precedes every allocation. While a slot is free, its first bytes hold the
+ * next free slot instead. */
+struct SlotHeader
+{
+    AppObjectPool* pool;
+    std::size_t size;
+};
+
+// Keeps the objects aligned like the global operator new does
+const std::size_t HEADER_SIZE = 16;
+static_assert(sizeof(SlotHeader) <= HEADER_SIZE, "The slot header does not fit");
+}
+
+/*******************************************************************************
+ * CONSTRUCTOR AND DESTRUCTOR
+ */
+AppObjectPool::AppObjectPool(int slotsPerBlock)
+    : m_slotsPerBlock(slotsPerBlock)
+    , m_liveCount(0)
+    , m_reservedBytes(0)
+{
+}
+
+AppObjectPool::~AppObjectPool()
+{
+    for (auto iter = m_blocks.constBegin(); iter != m_blocks.constEnd(); ++iter)
+    {
+        ::operator delete(*iter);
+    }
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ */
+void* AppObjectPool::allocate(std::size_t size)
+{
+    std::size_t slotSize = (size+HEADER_SIZE+HEADER_SIZE-1) & ~(HEADER_SIZE-1);
+    void*& head = m_freeLists[slotSize];
+    if (head == 0)
+    {
+        // Reserve a new block and chain its slots into the free list
+        char* block = static_cast<char*>(::operator new(slotSize*m_slotsPerBlock));
+        m_blocks.append(block);
+        m_reservedBytes += slotSize*m_slotsPerBlock;
+        for (int i = m_slotsPerBlock-1; i >= 0; --i)
+        {
+            char* slot = block+i*slotSize;
+            *reinterpret_cast<void**>(slot) = head;
+            head = slot;
+        }
+    }
+    char* slot = static_cast<char*>(head);
+    head = *reinterpret_cast<void**>(slot);
+    SlotHeader* header = reinterpret_cast<SlotHeader*>(slot);
+    header->pool = this;
+    header->size = slotSize;
+    ++m_liveCount;
+    return slot+HEADER_SIZE;
+}
+
+void* AppObjectPool::allocateUnpooled(std::size_t size)
+{
+    char* slot = static_cast<char*>(::operator new(size+HEADER_SIZE));
+    SlotHeader* header = reinterpret_cast<SlotHeader*>(slot);
+    header->pool = 0;
+    header->size = size+HEADER_SIZE;
+    return slot+HEADER_SIZE;
+}
+
+void AppObjectPool::deallocate(void* pointer)
+{
+    if (pointer == 0)
+    {
+        return;
+    }
+    char* slot = static_cast<char*>(pointer)-HEADER_SIZE;
+    SlotHeader* header = reinterpret_cast<SlotHeader*>(slot);
+    AppObjectPool* pool = header->pool;
+    if (pool == 0)
+    {
+        ::operator delete(slot);
+        return;
+    }
+    void*& head = pool->m_freeLists[header->size];
+    *reinterpret_cast<void**>(slot) = head;
+    head = slot;
+    --pool->m_liveCount;
+}
@@ -0,0 +1,70 @@
+#ifndef APPOBJECTPOOL_HH
+#define APPOBJECTPOOL_HH
+
+#include <QHash>
+#include <QList>
+#include <cstddef>
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppObjectPool is an arena allocator for AppObjects. Memory is reserved
+/// in blocks of equally sized slots, one free list per slot size, so creating
+/// and deleting objects does not go through the global heap and the objects of
+/// a handler lie next to each other in memory. Every allocation is preceded by
+/// a small header that tells deallocate() where the memory came from, which
+/// lets the same operator delete serve both pooled and heap allocated objects.
+/// The blocks are released when the pool is destroyed, so all the objects
+/// allocated from it must be deleted before that.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppObjectPool
+{
+public:
+    /***************************************************************************
+     * CONSTRUCTOR AND DESTRUCTOR
+     */
+    /**
+     * @param slotsPerBlock The number of objects reserved at a time for each
+     * object size
+     */
+    explicit AppObjectPool(int slotsPerBlock=256);
+
+    /** Releases all the reserved blocks. */
+    ~AppObjectPool();
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    /** Returns memory for an object of the given size from the pool. */
+    void* allocate(std::size_t size);
+
+    /** Returns memory for an object of the given size from the global heap. */
+    static void* allocateUnpooled(std::size_t size);
+
+    /**
+     * Returns the memory to the pool it was allocated from, or to the global
+     * heap if it was allocated with allocateUnpooled().
+     */
+    static void deallocate(void* pointer);
+
+    /** Returns the number of objects currently allocated from the pool. */
+    int liveCount() const {return m_liveCount;}
+
+    /** Returns the number of bytes reserved by the pool. */
+    std::size_t reservedBytes() const {return m_reservedBytes;}
+
+private:
+    Q_DISABLE_COPY(AppObjectPool)
+
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    int m_slotsPerBlock;
+    int m_liveCount;
+    std::size_t m_reservedBytes;
+    QHash<std::size_t, void*> m_freeLists;  ///< The first free slot of each slot size
+    QList<void*> m_blocks;                  ///< The reserved blocks
+};
+
+#endif // APPOBJECTPOOL_HH
@@ -0,0 +1,87 @@
+#include "appobjectprefab.hh"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonParseError>
+
+/*******************************************************************************
+ * CONSTRUCTOR AND DESTRUCTOR
+ */
+AppObjectPrefab::AppObjectPrefab()
+{
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ */
+void AppObjectPrefab::addItem(const QString& qmlPath,
+                              const QString& name,
+                              const QString& layer,
+                              const QVariantMap& properties)
+{
+    Item item;
+    item.qmlPath = qmlPath;
+    item.name = name;
+    item.layer = layer;
+    item.properties = properties;
+    m_items.append(item);
+}
+
+const QList<AppObjectPrefab::Item>& AppObjectPrefab::items() const
+{
+    return m_items;
+}
+
+QStringList AppObjectPrefab::componentPaths() const
+{
+    QStringList paths;
+    for (auto iter = m_items.constBegin(); iter != m_items.constEnd(); ++iter)
+    {
+        if (!paths.contains(iter->qmlPath))
+        {
+            paths.append(iter->qmlPath);
+        }
+    }
+    return paths;
+}
+
+bool AppObjectPrefab::isEmpty() const
+{
+    return m_items.isEmpty();
+}
+
+AppObjectPrefab AppObjectPrefab::fromJson(const QByteArray& json,
+                                          QString* errorString)
+{
+    AppObjectPrefab prefab;
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(json, &error);
+    if (error.error != QJsonParseError::NoError)
+    {
+        if (errorString)
+        {
+            *errorString = error.errorString();
+        }
+        return prefab;
+    }
+    QJsonArray items = document.object().value("items").toArray();
+    for (auto iter = items.constBegin(); iter != items.constEnd(); ++iter)
+    {
+        QJsonObject item = (*iter).toObject();
+        QString qmlPath = item.value("component").toString();
+        QString name = item.value("name").toString();
+        if (qmlPath.isEmpty() || name.isEmpty())
+        {
+            if (errorString)
+            {
+                *errorString = "Every item needs a component and a name";
+            }
+            return AppObjectPrefab();
+        }
+        prefab.addItem(qmlPath,
+                       name,
+                       item.value("layer").toString(),
+                       item.value("properties").toObject().toVariantMap());
+    }
+    return prefab;
+}
@@ -0,0 +1,74 @@
+#ifndef APPOBJECTPREFAB_HH
+#define APPOBJECTPREFAB_HH
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppObjectPrefab is a declarative description of an AppObject: the list
+/// of QQuickItems (component path, item name, layer and initial properties)
+/// the object consists of. A prefab is registered once to an AppObjectHandler,
+/// which can then spawn any number of AppObjects from it. A prefab can be
+/// written in code or loaded from JSON of the form:
+///
+///   { "items": [ { "component": "Enemy.qml",
+///                  "name": "body",
+///                  "layer": "gameLayer",
+///                  "properties": { "color": "red" } } ] }
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppObjectPrefab
+{
+public:
+    /** One QQuickItem of the prefab. */
+    struct Item
+    {
+        QString qmlPath;         ///< Path to the component, relative to the root folder
+        QString name;            ///< Name of the item in the AppObject
+        QString layer;           ///< objectName of the layer the item is placed in
+        QVariantMap properties;  ///< Initial property values of the item
+    };
+
+    /***************************************************************************
+     * CONSTRUCTOR AND DESTRUCTOR
+     */
+    AppObjectPrefab();
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    /** Appends an item to the prefab. */
+    void addItem(const QString& qmlPath,
+                 const QString& name,
+                 const QString& layer,
+                 const QVariantMap& properties=QVariantMap());
+
+    /** Returns the items of the prefab in the order they were added. */
+    const QList<Item>& items() const;
+
+    /** Returns the distinct component paths used by the items. */
+    QStringList componentPaths() const;
+
+    bool isEmpty() const;
+
+    /**
+     * Parses a prefab from JSON.
+     * @param json The JSON document
+     * @param errorString Set to a description of the error if parsing fails
+     * @return The parsed prefab, empty if the parsing failed
+     */
+    static AppObjectPrefab fromJson(const QByteArray& json,
+                                    QString* errorString=0);
+
+private:
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    QList<Item> m_items;  ///< The QQuickItems the spawned objects consist of
+};
+
+#endif // APPOBJECTPREFAB_HH
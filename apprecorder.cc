@@ -0,0 +1,440 @@
+#include "apprecorder.hh"
+#include "appwindow.hh"
+#include "appobject.hh"
+#include "appobjecthandler.hh"
+#include "applogging.hh"
+#include <QIODevice>
+#include <QDataStream>
+#include <cstring>
+
+namespace
+{
+/** Returns the bits of the float. */
+quint32 floatBits(float value)
+{
+    quint32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/** Returns the number of trailing zero bits, 32 for 0. */
+int trailingZeros(quint32 value)
+{
+    if (value == 0)
+    {
+        return 32;
+    }
+    int count = 0;
+    while ((value & 1) == 0)
+    {
+        value >>= 1;
+        ++count;
+    }
+    return count;
+}
+}
+
+/*******************************************************************************
+ * Scope
+ */
+AppRecorder::Scope::Scope(AppRecorder* recorder, Operation operation,
+                          const QString& view, const QString& layer)
+    : m_recorder(recorder)
+{
+    if (m_recorder)
+    {
+        if (operation != Operation(0))
+        {
+            m_recorder->recordView(operation, view, layer);
+        }
+        ++m_recorder->m_depth;
+    }
+}
+
+AppRecorder::Scope::~Scope()
+{
+    if (m_recorder)
+    {
+        --m_recorder->m_depth;
+    }
+}
+
+/*******************************************************************************
+ * CONSTRUCTOR AND DESTRUCTOR
+ */
+AppRecorder::AppRecorder(AppWindow* window)
+    : QObject(window)
+    , m_window(window)
+    , m_device(0)
+    , m_lastFrame(0)
+    , m_depth(0)
+    , m_nextObjectId(1)
+    , m_bytesWritten(0)
+    , m_operations(0)
+{
+}
+
+AppRecorder::~AppRecorder()
+{
+    stop();
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ */
+void AppRecorder::start(QIODevice* device)
+{
+    stop();
+    m_device = device;
+    m_buffer.clear();
+    m_names.clear();
+    m_objects.clear();
+    m_geometry.clear();
+    m_nextObjectId = 1;
+    m_bytesWritten = 0;
+    m_operations = 0;
+    m_depth = 0;
+    m_buffer.append("APPR");
+    m_buffer.append(char(VERSION));
+    writeSnapshot();
+    m_clock.start();
+    m_lastFrame = 0;
+    connect(m_window, SIGNAL(frameSwapped()), this, SLOT(markFrame()));
+    m_window->setRecorder(this);
+    flush();
+}
+
+void AppRecorder::stop()
+{
+    if (!m_device)
+    {
+        return;
+    }
+    disconnect(m_window, SIGNAL(frameSwapped()), this, SLOT(markFrame()));
+    if (m_window->recorder() == this)
+    {
+        m_window->setRecorder(0);
+    }
+    flush();
+    m_device = 0;
+}
+
+/*******************************************************************************
+ * RECORDING
+ */
+void AppRecorder::recordCreate(AppObjectHandler* handler, AppObject* object)
+{
+    // Objects created inside a recorded spawn get their ids in order
+    quint32 id = objectId(object);
+    if (!isWritable())
+    {
+        return;
+    }
+    writeOperation(CreateObject);
+    writeVarint(m_window->getHandlers().indexOf(handler));
+    writeVarint(id);
+}
+
+void AppRecorder::recordDestroy(AppObject* object)
+{
+    if (!m_device || !m_objects.contains(object))
+    {
+        return;
+    }
+    quint32 id = m_objects.take(object);
+    m_geometry.remove(id);
+    if (m_depth == 0)
+    {
+        writeOperation(DestroyObject);
+        writeVarint(id);
+    }
+}
+
+void AppRecorder::recordSpawn(AppObjectHandler* handler, const QString& prefab,
+                              int count, const QList<QVariantMap>& initialStates)
+{
+    if (!isWritable())
+    {
+        return;
+    }
+    writeOperation(Spawn);
+    writeVarint(m_window->getHandlers().indexOf(handler));
+    writeVarint(m_nextObjectId);
+    writeName(prefab);
+    writeVarint(count);
+    QVariantList states;
+    for (auto iter = initialStates.constBegin(); iter != initialStates.constEnd(); ++iter)
+    {
+        states.append(*iter);
+    }
+    writeVariant(states);
+}
+
+void AppRecorder::recordAddItem(AppObject* object, const QString& qmlPath, const QString& name,
+                                const QString& layer, const QVariant& initialProperties)
+{
+    if (!isWritable())
+    {
+        return;
+    }
+    writeOperation(AddItem);
+    writeVarint(objectId(object));
+    writeName(qmlPath);
+    writeName(name);
+    writeName(layer);
+    writeVariant(initialProperties);
+}
+
+void AppRecorder::recordRemoveItem(AppObject* object, const QString& name)
+{
+    if (!isWritable())
+    {
+        return;
+    }
+    writeOperation(RemoveItem);
+    writeVarint(objectId(object));
+    writeName(name);
+}
+
+void AppRecorder::recordGeometry(AppObject* object, GeometryField field, float value)
+{
+    if (!isWritable())
+    {
+        return;
+    }
+    quint32 id = objectId(object);
+    QVector<quint32>& previous = m_geometry[id];
+    if (previous.isEmpty())
+    {
+        previous.fill(0, GeometryFieldCount);
+    }
+    quint32 bits = floatBits(value);
+    quint32 delta = bits^previous[field];
+    previous[field] = bits;
+    // The XOR of close values has its set bits in the middle, so the trailing
+    // zeros are stored in the low 5 bits and the rest shifted down
+    int zeros = trailingZeros(delta) & 31;
+    writeOperation(SetGeometry);
+    writeVarint(id);
+    writeVarint(field);
+    writeVarint((quint64(delta >> zeros) << 5) | zeros);
+}
+
+void AppRecorder::recordZ(AppObject* object, int z)
+{
+    if (!isWritable())
+    {
+        return;
+    }
+    writeOperation(SetZ);
+    writeVarint(objectId(object));
+    writeSignedVarint(z);
+}
+
+void AppRecorder::recordProperties(AppObject* object, const char* property, const QVariant& value)
+{
+    if (!isWritable())
+    {
+        return;
+    }
+    writeOperation(SetProperties);
+    writeVarint(objectId(object));
+    writeName(QString::fromUtf8(property));
+    writeVariant(value);
+}
+
+void AppRecorder::recordProperty(AppObject* object, const QString& target,
+                                 const char* property, const QVariant& value)
+{
+    if (!isWritable())
+    {
+        return;
+    }
+    writeOperation(SetProperty);
+    writeVarint(objectId(object));
+    writeName(target);
+    writeName(QString::fromUtf8(property));
+    writeVariant(value);
+}
+
+void AppRecorder::recordChangeLayer(AppObject* object, const QString& target, const QString& layer)
+{
+    if (!isWritable())
+    {
+        return;
+    }
+    writeOperation(ChangeLayer);
+    writeVarint(objectId(object));
+    writeName(target);
+    writeName(layer);
+}
+
+void AppRecorder::recordView(Operation operation, const QString& view, const QString& layer)
+{
+    if (!isWritable())
+    {
+        return;
+    }
+    writeOperation(operation);
+    if (operation == UnloadAllViews || operation == HideAllViews)
+    {
+        return;
+    }
+    writeName(view);
+    if (operation == ShowView)
+    {
+        writeName(layer);
+    }
+}
+
+void AppRecorder::recordProgressiveView(const QString& view, bool show)
+{
+    if (!isWritable())
+    {
+        return;
+    }
+    writeOperation(LoadProgressiveView);
+    writeName(view);
+    writeVarint(show ? 1 : 0);
+}
+
+void AppRecorder::recordState(AppObject* object, bool withItems)
+{
+    if (!isWritable())
+    {
+        return;
+    }
+    recordGeometry(object, X, object->getX());
+    recordGeometry(object, Y, object->getY());
+    recordGeometry(object, Width, object->getWidth());
+    recordGeometry(object, Height, object->getHeight());
+    recordGeometry(object, Rotation, object->getRotation());
+    recordZ(object, object->getZ());
+    for (int i = 0; withItems && i < object->m_items.size(); ++i)
+    {
+        const AppObject::Item& item = object->m_items[i];
+        // Items given with setQuickItem() cannot be recreated
+        if (!item.qmlPath.isEmpty())
+        {
+            recordAddItem(object, item.qmlPath, item.name, item.layer,
+                          item.isVirtual ? QVariant(item.state) : QVariant());
+        }
+    }
+}
+
+/*******************************************************************************
+ * SLOTS
+ */
+void AppRecorder::markFrame()
+{
+    if (!m_device)
+    {
+        return;
+    }
+    qint64 now = m_clock.nsecsElapsed()/1000;
+    writeOperation(Frame);
+    writeVarint(now-m_lastFrame);
+    m_lastFrame = now;
+    flush();
+}
+
+/*******************************************************************************
+ * PRIVATE FUNCTIONS
+ */
+quint32 AppRecorder::objectId(AppObject* object)
+{
+    auto iter = m_objects.find(object);
+    if (iter == m_objects.end())
+    {
+        iter = m_objects.insert(object, m_nextObjectId++);
+    }
+    return *iter;
+}
+
+void AppRecorder::writeSnapshot()
+{
+    QStringList views = m_window->getLoadedViews();
+    for (auto iter = views.constBegin(); iter != views.constEnd(); ++iter)
+    {
+        recordView(LoadView, *iter);
+        QQuickItem* view = m_window->getView(*iter);
+        if (view->parentItem() && view->isVisible())
+        {
+            recordView(ShowView, *iter);
+        }
+    }
+    QList<AppObjectHandler*> handlers = m_window->getHandlers();
+    for (auto handler = handlers.constBegin(); handler != handlers.constEnd(); ++handler)
+    {
+        const QVector<AppObject*>& objects = (*handler)->objects();
+        for (auto iter = objects.constBegin(); iter != objects.constEnd(); ++iter)
+        {
+            recordCreate(*handler, *iter);
+            recordState(*iter);
+        }
+    }
+}
+
+void AppRecorder::writeOperation(Operation operation)
+{
+    m_buffer.append(char(operation));
+    ++m_operations;
+}
+
+void AppRecorder::writeVarint(quint64 value)
+{
+    while (value >= 0x80)
+    {
+        m_buffer.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    m_buffer.append(char(value));
+}
+
+void AppRecorder::writeSignedVarint(qint64 value)
+{
+    writeVarint((quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+void AppRecorder::writeName(const QString& name)
+{
+    // A known name is written as its id+1, a new one as 0 and its UTF-8
+    // string, after which it has the next id
+    auto iter = m_names.constFind(name);
+    if (iter != m_names.constEnd())
+    {
+        writeVarint(*iter+1);
+        return;
+    }
+    m_names.insert(name, m_names.size());
+    QByteArray utf8 = name.toUtf8();
+    writeVarint(0);
+    writeVarint(utf8.size());
+    m_buffer.append(utf8);
+}
+
+void AppRecorder::writeVariant(const QVariant& value)
+{
+    QByteArray bytes;
+    QDataStream stream(&bytes, QIODevice::WriteOnly);
+    stream << value;
+    writeVarint(bytes.size());
+    m_buffer.append(bytes);
+}
+
+void AppRecorder::flush()
+{
+    if (m_device && !m_buffer.isEmpty())
+    {
+        qint64 written = m_device->write(m_buffer);
+        if (written < 0)
+        {
+            appCWarning(lcAppCapture, QString()) << Q_FUNC_INFO << ": Cannot write the recording: "+m_device->errorString();
+        }
+        else
+        {
+            m_bytesWritten += written;
+        }
+        m_buffer.clear();
+    }
+}
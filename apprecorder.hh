@@ -0,0 +1,195 @@
+#ifndef APPRECORDER_HH
+#define APPRECORDER_HH
+
+#include <QObject>
+#include <QHash>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QVariant>
+class QIODevice;
+class AppWindow;
+class AppObject;
+class AppObjectHandler;
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppRecorder records the mutations made through the AppWindow and
+/// AppObject API into a compact binary log, which the AppReplayer plays back
+/// on the same app to reproduce a session, e.g. as a benchmark. Recorded are
+/// the creation, spawning and destruction of AppObjects, their items,
+/// geometry, properties and layers, and the loading, showing and switching of
+/// views, together with the times of the frames they happened in.
+///
+/// The log starts with the magic "APPR" and a version byte, followed by
+/// operations: an operation byte and its arguments. Integers are varints,
+/// names are interned and written in full only on first use, and the geometry is
+/// stored as the XOR of the float with the previous value of the same field,
+/// which is small for small changes. Objects that exist when the recording is
+/// started, and the loaded views, are written first.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** The operations of the log. */
+    enum Operation
+    {
+        Frame = 1,          ///< microseconds since the previous frame
+        CreateObject,       ///< handler, object
+        DestroyObject,      ///< object
+        Spawn,              ///< handler, first object, prefab, count, states
+        AddItem,            ///< object, qmlPath, name, layer, properties or invalid
+        RemoveItem,         ///< object, name
+        SetGeometry,        ///< object, field, XOR of the float
+        SetZ,               ///< object, z
+        SetProperties,      ///< object, property, value
+        SetProperty,        ///< object, target, property, value
+        ChangeLayer,        ///< object, target, layer
+        LoadView,           ///< view
+        LoadProgressiveView,///< view, show
+        ShowView,           ///< view, layer
+        HideView,           ///< view
+        SwitchView,         ///< view
+        ReplaceView,        ///< view
+        UnloadView,         ///< view
+        UnloadAllViews,
+        HideAllViews
+    };
+
+    /** The float fields of an AppObject. */
+    enum GeometryField
+    {
+        X,
+        Y,
+        CenterX,
+        CenterY,
+        Width,
+        Height,
+        Rotation,
+        GeometryFieldCount
+    };
+
+    static const quint8 VERSION = 1;
+
+    /**
+     * Suppresses the recording of the calls nested in a recorded call, e.g.
+     * the showView() inside switchView(), for its lifetime.
+     */
+    class Scope
+    {
+    public:
+        /** Records the view operation unless nested, then suppresses. */
+        Scope(AppRecorder* recorder, Operation operation=Operation(0),
+              const QString& view=QString(), const QString& layer=QString());
+        ~Scope();
+
+    private:
+        AppRecorder* m_recorder;
+    };
+
+    /***************************************************************************
+     * CONSTRUCTOR AND DESTRUCTOR
+     */
+    /**
+     * @param window The window whose mutations are recorded
+     */
+    explicit AppRecorder(AppWindow* window);
+
+    /** Stops the recording. */
+    virtual ~AppRecorder();
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    /**
+     * Starts recording into the device, which must be open for writing. The
+     * log is flushed on every frame.
+     */
+    void start(QIODevice* device);
+
+    /** Flushes the log and stops recording. */
+    void stop();
+
+    bool isRecording() const {return m_device != 0;}
+
+    /** Returns the number of bytes written. */
+    qint64 getBytesWritten() const {return m_bytesWritten;}
+
+    /** Returns the number of operations recorded. */
+    int getOperationCount() const {return m_operations;}
+
+    /***************************************************************************
+     * RECORDING, called by the recorded classes
+     */
+    void recordCreate(AppObjectHandler* handler, AppObject* object);
+    void recordDestroy(AppObject* object);
+    void recordSpawn(AppObjectHandler* handler, const QString& prefab,
+                     int count, const QList<QVariantMap>& initialStates);
+    /** @param initialProperties A QVariantMap, or invalid if none were given */
+    void recordAddItem(AppObject* object, const QString& qmlPath, const QString& name,
+                       const QString& layer, const QVariant& initialProperties);
+    void recordRemoveItem(AppObject* object, const QString& name);
+    void recordGeometry(AppObject* object, GeometryField field, float value);
+    void recordZ(AppObject* object, int z);
+    void recordProperties(AppObject* object, const char* property, const QVariant& value);
+    void recordProperty(AppObject* object, const QString& target,
+                        const char* property, const QVariant& value);
+    void recordChangeLayer(AppObject* object, const QString& target, const QString& layer);
+    void recordView(Operation operation, const QString& view, const QString& layer=QString());
+    void recordProgressiveView(const QString& view, bool show);
+
+    /** Records the geometry and, with withItems, the items of an object that
+     * was filled in directly, e.g. restored from a snapshot. */
+    void recordState(AppObject* object, bool withItems=true);
+
+public slots:
+    /***************************************************************************
+     * SLOTS
+     */
+    /** Marks the start of a new frame. Called on every frame of the window,
+     * and can be called manually for windows that are not shown. */
+    void markFrame();
+
+private:
+    /***************************************************************************
+     * PRIVATE FUNCTIONS
+     */
+    /** Returns true if a call should be written now. */
+    bool isWritable() const {return m_device && m_depth == 0;}
+
+    /** Returns the id of the object, assigning a new one if needed. */
+    quint32 objectId(AppObject* object);
+
+    /** Writes the records of the existing objects and views. */
+    void writeSnapshot();
+
+    void writeOperation(Operation operation);
+    void writeVarint(quint64 value);
+    void writeSignedVarint(qint64 value);
+    void writeName(const QString& name);
+    void writeVariant(const QVariant& value);
+
+    /** Writes the buffer to the device. */
+    void flush();
+
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    AppWindow* m_window;
+    QIODevice* m_device;
+    QByteArray m_buffer;
+    QElapsedTimer m_clock;
+    qint64 m_lastFrame;                     ///< Microseconds on m_clock
+    int m_depth;                            ///< Nesting of the recorded calls
+    QHash<QString, quint32> m_names;        ///< The interned names
+    QHash<AppObject*, quint32> m_objects;   ///< Ids of the objects
+    QHash<quint32, QVector<quint32> > m_geometry;  ///< Previous float bits of the objects
+    quint32 m_nextObjectId;
+    qint64 m_bytesWritten;
+    int m_operations;
+};
+
+#endif // APPRECORDER_HH
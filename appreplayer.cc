@@ -0,0 +1,484 @@
+#include "appreplayer.hh"
+#include "apprecorder.hh"
+#include "appwindow.hh"
+#include "appobject.hh"
+#include "appobjecthandler.hh"
+#include "applogging.hh"
+#include <QIODevice>
+#include <QDataStream>
+#include <cstring>
+
+namespace
+{
+/** Reads the values of a log in order, and remembers if it runs out. */
+class LogReader
+{
+public:
+    explicit LogReader(const QByteArray& data)
+        : m_data(data)
+        , m_position(0)
+        , m_failed(false)
+    {
+    }
+
+    bool atEnd() const {return m_position >= m_data.size();}
+    bool failed() const {return m_failed;}
+
+    quint8 readByte()
+    {
+        if (atEnd())
+        {
+            m_failed = true;
+            return 0;
+        }
+        return quint8(m_data[m_position++]);
+    }
+
+    quint64 readVarint()
+    {
+        quint64 value = 0;
+        for (int shift = 0; shift < 64 && !m_failed; shift += 7)
+        {
+            quint8 byte = readByte();
+            value |= quint64(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                break;
+            }
+        }
+        return value;
+    }
+
+    qint64 readSignedVarint()
+    {
+        quint64 value = readVarint();
+        return qint64(value >> 1) ^ -qint64(value & 1);
+    }
+
+    QByteArray readBytes(int size)
+    {
+        if (size < 0 || m_position+size > m_data.size())
+        {
+            m_failed = true;
+            return QByteArray();
+        }
+        QByteArray bytes = m_data.mid(m_position, size);
+        m_position += size;
+        return bytes;
+    }
+
+    /** Reads an interned name into the table and returns its index. */
+    int readName(QStringList& names)
+    {
+        quint64 id = readVarint();
+        if (id > 0)
+        {
+            if (id > quint64(names.size()))
+            {
+                m_failed = true;
+                return 0;
+            }
+            return int(id-1);
+        }
+        names.append(QString::fromUtf8(readBytes(int(readVarint()))));
+        return names.size()-1;
+    }
+
+    QVariant readVariant()
+    {
+        QByteArray bytes = readBytes(int(readVarint()));
+        QDataStream stream(bytes);
+        QVariant value;
+        stream >> value;
+        return value;
+    }
+
+private:
+    QByteArray m_data;
+    int m_position;
+    bool m_failed;
+};
+}
+
+/*******************************************************************************
+ * CONSTRUCTOR AND DESTRUCTOR
+ */
+AppReplayer::AppReplayer(AppWindow* window)
+    : QObject(window)
+    , m_window(window)
+    , m_nextFrame(0)
+    , m_lastReplayNsec(0)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(playDueFrames()));
+}
+
+AppReplayer::~AppReplayer()
+{
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ */
+bool AppReplayer::load(QIODevice* device, QString* errorString)
+{
+    stop();
+    clear();
+    QByteArray data = device->readAll();
+    if (!data.startsWith("APPR") || data.size() < 5 || quint8(data[4]) != AppRecorder::VERSION)
+    {
+        if (errorString)
+        {
+            *errorString = "Not a recording of a supported version";
+        }
+        return false;
+    }
+    LogReader reader(data.mid(5));
+    QHash<quint32, QVector<quint32> > geometry;     // Previous float bits of the objects
+    qint64 time = 0;
+    m_frameStarts.append(0);
+    m_frameTimes.append(0);
+    while (!reader.atEnd() && !reader.failed())
+    {
+        Operation operation;
+        operation.type = reader.readByte();
+        operation.object = 0;
+        operation.handler = 0;
+        operation.names[0] = operation.names[1] = operation.names[2] = -1;
+        operation.count = 0;
+        operation.value = 0;
+        switch (operation.type)
+        {
+        case AppRecorder::Frame:
+            time += reader.readVarint()*1000;
+            m_frameStarts.append(m_operations.size());
+            m_frameTimes.append(time);
+            continue;
+        case AppRecorder::CreateObject:
+            operation.handler = reader.readVarint();
+            operation.object = reader.readVarint();
+            break;
+        case AppRecorder::DestroyObject:
+            operation.object = reader.readVarint();
+            break;
+        case AppRecorder::Spawn:
+            operation.handler = reader.readVarint();
+            operation.object = reader.readVarint();
+            operation.names[0] = reader.readName(m_names);
+            operation.count = reader.readVarint();
+            operation.variant = reader.readVariant();
+            break;
+        case AppRecorder::AddItem:
+            operation.object = reader.readVarint();
+            operation.names[0] = reader.readName(m_names);
+            operation.names[1] = reader.readName(m_names);
+            operation.names[2] = reader.readName(m_names);
+            operation.variant = reader.readVariant();
+            break;
+        case AppRecorder::RemoveItem:
+            operation.object = reader.readVarint();
+            operation.names[0] = reader.readName(m_names);
+            break;
+        case AppRecorder::SetGeometry:
+        {
+            operation.object = reader.readVarint();
+            operation.count = reader.readVarint();
+            quint64 encoded = reader.readVarint();
+            QVector<quint32>& previous = geometry[operation.object];
+            if (previous.isEmpty())
+            {
+                previous.fill(0, AppRecorder::GeometryFieldCount);
+            }
+            if (operation.count >= AppRecorder::GeometryFieldCount)
+            {
+                reader.readBytes(-1);
+                break;
+            }
+            quint32 bits = previous[operation.count]^quint32((encoded >> 5) << (encoded & 31));
+            previous[operation.count] = bits;
+            std::memcpy(&operation.value, &bits, sizeof(bits));
+            break;
+        }
+        case AppRecorder::SetZ:
+            operation.object = reader.readVarint();
+            operation.count = reader.readSignedVarint();
+            break;
+        case AppRecorder::SetProperties:
+            operation.object = reader.readVarint();
+            operation.names[0] = reader.readName(m_names);
+            operation.variant = reader.readVariant();
+            break;
+        case AppRecorder::SetProperty:
+            operation.object = reader.readVarint();
+            operation.names[0] = reader.readName(m_names);
+            operation.names[1] = reader.readName(m_names);
+            operation.variant = reader.readVariant();
+            break;
+        case AppRecorder::ChangeLayer:
+            operation.object = reader.readVarint();
+            operation.names[0] = reader.readName(m_names);
+            operation.names[1] = reader.readName(m_names);
+            break;
+        case AppRecorder::ShowView:
+            operation.names[0] = reader.readName(m_names);
+            operation.names[1] = reader.readName(m_names);
+            break;
+        case AppRecorder::LoadProgressiveView:
+            operation.names[0] = reader.readName(m_names);
+            operation.count = reader.readVarint();
+            break;
+        case AppRecorder::LoadView:
+        case AppRecorder::HideView:
+        case AppRecorder::SwitchView:
+        case AppRecorder::ReplaceView:
+        case AppRecorder::UnloadView:
+            operation.names[0] = reader.readName(m_names);
+            break;
+        case AppRecorder::UnloadAllViews:
+        case AppRecorder::HideAllViews:
+            break;
+        default:
+            reader.readBytes(-1);
+            break;
+        }
+        if (!reader.failed())
+        {
+            m_operations.append(operation);
+        }
+    }
+    if (reader.failed())
+    {
+        if (errorString)
+        {
+            *errorString = "The recording is corrupt or truncated";
+        }
+        appCWarning(lcAppCapture, QString()) << Q_FUNC_INFO << ": The recording is corrupt or truncated after "
+                                             +QString::number(m_operations.size())+" operations, nothing is loaded";
+        clear();
+        return false;
+    }
+    for (auto iter = m_names.constBegin(); iter != m_names.constEnd(); ++iter)
+    {
+        m_propertyNames.append(iter->toUtf8());
+    }
+    return true;
+}
+
+void AppReplayer::play(Mode mode)
+{
+    stop();
+    // Otherwise a second replay would add its scene to the first one
+    for (auto iter = m_objects.constBegin(); iter != m_objects.constEnd(); ++iter)
+    {
+        delete iter->data();
+    }
+    m_objects.clear();
+    m_nextFrame = 0;
+    m_clock.start();
+    if (mode == AsFastAsPossible)
+    {
+        while (m_nextFrame < m_frameStarts.size())
+        {
+            playFrame(m_nextFrame++);
+        }
+        finish();
+    }
+    else
+    {
+        playDueFrames();
+    }
+}
+
+void AppReplayer::stop()
+{
+    m_timer.stop();
+}
+
+qint64 AppReplayer::getRecordedDuration() const
+{
+    return m_frameTimes.isEmpty() ? 0 : m_frameTimes.last();
+}
+
+/*******************************************************************************
+ * PRIVATE SLOTS
+ */
+void AppReplayer::playDueFrames()
+{
+    qint64 now = m_clock.nsecsElapsed();
+    while (m_nextFrame < m_frameStarts.size() && m_frameTimes[m_nextFrame] <= now)
+    {
+        playFrame(m_nextFrame++);
+    }
+    if (m_nextFrame >= m_frameStarts.size())
+    {
+        finish();
+        return;
+    }
+    m_timer.start(int((m_frameTimes[m_nextFrame]-now)/1000000));
+}
+
+/*******************************************************************************
+ * PRIVATE FUNCTIONS
+ */
+void AppReplayer::clear()
+{
+    m_operations.clear();
+    m_frameStarts.clear();
+    m_frameTimes.clear();
+    m_names.clear();
+    m_propertyNames.clear();
+}
+
+void AppReplayer::playFrame(int frame)
+{
+    int end = frame+1 < m_frameStarts.size() ? m_frameStarts[frame+1] : m_operations.size();
+    for (int i = m_frameStarts[frame]; i < end; ++i)
+    {
+        apply(m_operations[i]);
+    }
+    emit frameReplayed(frame);
+}
+
+void AppReplayer::apply(const Operation& operation)
+{
+    AppObjectHandler* handler = 0;
+    AppObject* target = 0;
+    switch (operation.type)
+    {
+    case AppRecorder::CreateObject:
+        handler = m_window->getHandlers().value(operation.handler);
+        if (handler)
+        {
+            m_objects[operation.object] = handler->createObject();
+        }
+        break;
+    case AppRecorder::DestroyObject:
+        delete object(operation.object);
+        m_objects.remove(operation.object);
+        break;
+    case AppRecorder::Spawn:
+    {
+        handler = m_window->getHandlers().value(operation.handler);
+        if (!handler)
+        {
+            break;
+        }
+        QList<QVariantMap> states;
+        QVariantList recorded = operation.variant.toList();
+        for (auto iter = recorded.constBegin(); iter != recorded.constEnd(); ++iter)
+        {
+            states.append(iter->toMap());
+        }
+        QList<AppObject*> objects = handler->spawn(m_names[operation.names[0]], operation.count, states);
+        for (int i = 0; i < objects.size(); ++i)
+        {
+            m_objects[operation.object+i] = objects[i];
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    if (operation.object != 0 && operation.type != AppRecorder::CreateObject
+            && operation.type != AppRecorder::DestroyObject
+            && operation.type != AppRecorder::Spawn)
+    {
+        target = object(operation.object);
+        if (!target)
+        {
+            return;
+        }
+    }
+    switch (operation.type)
+    {
+    case AppRecorder::AddItem:
+        if (operation.variant.isValid())
+        {
+            target->addQuickItem(m_names[operation.names[0]], m_names[operation.names[1]],
+                                 m_names[operation.names[2]], operation.variant.toMap());
+        }
+        else
+        {
+            target->addQuickItem(m_names[operation.names[0]], m_names[operation.names[1]],
+                                 m_names[operation.names[2]]);
+        }
+        break;
+    case AppRecorder::RemoveItem:
+        target->removeQuickItem(m_names[operation.names[0]]);
+        break;
+    case AppRecorder::SetGeometry:
+        switch (operation.count)
+        {
+        case AppRecorder::X: target->setX(operation.value); break;
+        case AppRecorder::Y: target->setY(operation.value); break;
+        case AppRecorder::CenterX: target->setCenterX(operation.value); break;
+        case AppRecorder::CenterY: target->setCenterY(operation.value); break;
+        case AppRecorder::Width: target->setWidth(operation.value); break;
+        case AppRecorder::Height: target->setHeight(operation.value); break;
+        case AppRecorder::Rotation: target->setRotation(operation.value); break;
+        }
+        break;
+    case AppRecorder::SetZ:
+        target->setZ(operation.count);
+        break;
+    case AppRecorder::SetProperties:
+        target->setProperties(property(operation.names[0]), operation.variant);
+        break;
+    case AppRecorder::SetProperty:
+        target->setProperty(m_names[operation.names[0]], property(operation.names[1]),
+                            operation.variant);
+        break;
+    case AppRecorder::ChangeLayer:
+        target->changeLayer(m_names[operation.names[0]], m_names[operation.names[1]]);
+        break;
+    case AppRecorder::LoadView:
+        if (!m_window->getLoadedViews().contains(m_names[operation.names[0]]))
+        {
+            m_window->loadView(m_names[operation.names[0]]);
+        }
+        break;
+    case AppRecorder::LoadProgressiveView:
+        m_window->loadProgressiveView(m_names[operation.names[0]], operation.count != 0);
+        break;
+    case AppRecorder::ShowView:
+        m_window->showView(m_names[operation.names[0]], m_names[operation.names[1]]);
+        break;
+    case AppRecorder::HideView:
+        m_window->hideView(m_names[operation.names[0]]);
+        break;
+    case AppRecorder::SwitchView:
+        m_window->switchView(m_names[operation.names[0]]);
+        break;
+    case AppRecorder::ReplaceView:
+        m_window->replaceView(m_names[operation.names[0]]);
+        break;
+    case AppRecorder::UnloadView:
+        m_window->unloadView(m_names[operation.names[0]]);
+        break;
+    case AppRecorder::UnloadAllViews:
+        m_window->unloadAllViews();
+        break;
+    case AppRecorder::HideAllViews:
+        m_window->hideAllViews();
+        break;
+    default:
+        break;
+    }
+}
+
+AppObject* AppReplayer::object(quint32 id) const
+{
+    return m_objects.value(id).data();
+}
+
+const char* AppReplayer::property(int name) const
+{
+    return m_propertyNames[name].constData();
+}
+
+void AppReplayer::finish()
+{
+    m_lastReplayNsec = m_clock.nsecsElapsed();
+    emit finished(m_lastReplayNsec);
+}
@@ -0,0 +1,140 @@
+#ifndef APPREPLAYER_HH
+#define APPREPLAYER_HH
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QPointer>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVariant>
+#include <QStringList>
+class QIODevice;
+class AppWindow;
+class AppObject;
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppReplayer plays a log written by the AppRecorder back on a window,
+/// calling the same AppWindow, AppObjectHandler and AppObject functions in
+/// the same order. The window must have the handlers of the recording, in the
+/// same order, and the prefabs they spawned. The log is played either at the
+/// recorded frame times or as fast as possible, e.g. on an AppHeadlessWindow
+/// that renders on frameReplayed().
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppReplayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Mode
+    {
+        RealTime,           ///< Frames are played at their recorded times
+        AsFastAsPossible    ///< All the frames are played at once in play()
+    };
+    Q_ENUM(Mode)
+
+    /***************************************************************************
+     * CONSTRUCTOR AND DESTRUCTOR
+     */
+    /**
+     * @param window The window the log is played on
+     */
+    explicit AppReplayer(AppWindow* window);
+
+    virtual ~AppReplayer();
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    /**
+     * Reads and decodes the log. Nothing is loaded from a corrupt or
+     * truncated log.
+     * @return False if the device does not contain a valid log
+     */
+    bool load(QIODevice* device, QString* errorString=0);
+
+    /** Plays the loaded log from the start. The objects created by a
+     * previous replay are deleted first. */
+    void play(Mode mode=RealTime);
+
+    /** Stops a real time replay. */
+    void stop();
+
+    bool isPlaying() const {return m_timer.isActive();}
+
+    int getFrameCount() const {return m_frameTimes.size();}
+    int getOperationCount() const {return m_operations.size();}
+
+    /** Returns the recorded duration in nanoseconds. */
+    qint64 getRecordedDuration() const;
+
+    /** Returns the duration of the last completed replay in nanoseconds. */
+    qint64 getLastReplayDuration() const {return m_lastReplayNsec;}
+
+signals:
+    /***************************************************************************
+     * SIGNALS
+     */
+    void frameReplayed(int frame);
+    void finished(qint64 durationNsec);
+
+private slots:
+    /***************************************************************************
+     * PRIVATE SLOTS
+     */
+    /** Plays the frames that are due. */
+    void playDueFrames();
+
+private:
+    /** A decoded operation. */
+    struct Operation
+    {
+        int type;
+        quint32 object;
+        quint32 handler;
+        int names[3];           ///< Indices to m_names
+        int count;              ///< z, count, geometry field or show
+        float value;
+        QVariant variant;
+    };
+
+    /***************************************************************************
+     * PRIVATE FUNCTIONS
+     */
+    /** Removes the loaded log. */
+    void clear();
+
+    /** Plays the operations of the frame, and emits frameReplayed(). */
+    void playFrame(int frame);
+
+    void apply(const Operation& operation);
+
+    /** Returns the object of the id, or null if it is gone. */
+    AppObject* object(quint32 id) const;
+
+    /** Returns the name as a property name. */
+    const char* property(int name) const;
+
+    /** Finishes the replay. */
+    void finish();
+
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    AppWindow* m_window;
+    QVector<Operation> m_operations;
+    QVector<int> m_frameStarts;             ///< Index of the first operation of each frame
+    QVector<qint64> m_frameTimes;           ///< Nanoseconds from the start
+    QStringList m_names;
+    QList<QByteArray> m_propertyNames;      ///< m_names in UTF-8 for setProperty()
+    QHash<quint32, QPointer<AppObject> > m_objects;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    int m_nextFrame;
+    qint64 m_lastReplayNsec;
+};
+
+#endif // APPREPLAYER_HH
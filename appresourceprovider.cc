@@ -0,0 +1,201 @@
+#include "appresourceprovider.hh"
+#include "applogging.hh"
+#include <QDir>
+#include <QFileInfo>
+#include <QResource>
+
+QMutex AppResourceProvider::s_mutex;
+QMap<QString, QSharedPointer<AppResourceProvider> > AppResourceProvider::s_providers;
+
+/*******************************************************************************
+ * CONSTRUCTOR AND DESTRUCTOR
+ */
+AppResourceProvider::AppResourceProvider()
+{
+}
+
+AppResourceProvider::~AppResourceProvider()
+{
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ */
+void AppResourceProvider::install(const QString &rootFolderPath,
+                                  AppResourceProvider *provider)
+{
+    // The previous provider may still be used by other threads, so it is
+    // released outside the lock when the last reference to it goes
+    QSharedPointer<AppResourceProvider> previous;
+    QMutexLocker locker(&s_mutex);
+    previous = s_providers.take(rootFolderPath);
+    if (provider)
+    {
+        provider->m_rootFolderPath = rootFolderPath;
+        s_providers.insert(rootFolderPath, QSharedPointer<AppResourceProvider>(provider));
+    }
+    locker.unlock();
+}
+
+QSharedPointer<AppResourceProvider> AppResourceProvider::forPath(const QString &path)
+{
+    QMutexLocker locker(&s_mutex);
+    // The map is sorted, so a longer root folder comes after its prefixes
+    QSharedPointer<AppResourceProvider> provider = defaultProvider();
+    for (auto iter = s_providers.constBegin(); iter != s_providers.constEnd(); ++iter)
+    {
+        if (path.startsWith(iter.key()))
+        {
+            provider = iter.value();
+        }
+    }
+    return provider;
+}
+
+AppResourceProvider::Stats AppResourceProvider::totalStats()
+{
+    QMutexLocker locker(&s_mutex);
+    Stats total;
+    total.filesResolved = defaultProvider()->stats().filesResolved;
+    total.bytesMapped = 0;
+    for (auto iter = s_providers.constBegin(); iter != s_providers.constEnd(); ++iter)
+    {
+        Stats stats = (*iter)->stats();
+        total.filesResolved += stats.filesResolved;
+        total.bytesMapped += stats.bytesMapped;
+    }
+    return total;
+}
+
+QString AppResourceProvider::path(const QString &path)
+{
+    m_filesResolved.ref();
+    return resolvePath(relative(path));
+}
+
+QUrl AppResourceProvider::url(const QString &path)
+{
+    m_filesResolved.ref();
+    return resolveUrl(relative(path));
+}
+
+AppResourceProvider::Stats AppResourceProvider::stats() const
+{
+    Stats stats;
+    stats.filesResolved = m_filesResolved.load();
+    stats.bytesMapped = bytesMapped();
+    return stats;
+}
+
+/*******************************************************************************
+ * PRIVATE FUNCTIONS
+ */
+QSharedPointer<AppResourceProvider> AppResourceProvider::defaultProvider()
+{
+    static QSharedPointer<AppResourceProvider> provider(new AppQrcProvider);
+    return provider;
+}
+
+QString AppResourceProvider::relative(const QString &path) const
+{
+    return path.mid(m_rootFolderPath.size());
+}
+
+/*******************************************************************************
+ * AppQrcProvider
+ */
+QString AppQrcProvider::resolvePath(const QString &relativePath)
+{
+    return ":/"+getRootFolderPath()+relativePath;
+}
+
+QUrl AppQrcProvider::resolveUrl(const QString &relativePath)
+{
+    return QUrl("qrc:///"+getRootFolderPath()+relativePath);
+}
+
+/*******************************************************************************
+ * AppDirectoryProvider
+ */
+AppDirectoryProvider::AppDirectoryProvider(const QString &directory)
+    : m_directory(QDir(directory).absolutePath())
+{
+}
+
+QString AppDirectoryProvider::resolvePath(const QString &relativePath)
+{
+    return m_directory+"/"+relativePath;
+}
+
+QUrl AppDirectoryProvider::resolveUrl(const QString &relativePath)
+{
+    return QUrl::fromLocalFile(m_directory+"/"+relativePath);
+}
+
+/*******************************************************************************
+ * AppArchiveProvider
+ */
+AppArchiveProvider::AppArchiveProvider(const QString &archivePath)
+    : m_archivePath(archivePath)
+    , m_registered(false)
+    , m_failed(false)
+    , m_bytesMapped(0)
+{
+}
+
+AppArchiveProvider::~AppArchiveProvider()
+{
+    if (m_registered)
+    {
+        QResource::unregisterResource(m_archivePath, mapRoot());
+    }
+}
+
+bool AppArchiveProvider::isRegistered() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_registered;
+}
+
+QString AppArchiveProvider::resolvePath(const QString &relativePath)
+{
+    ensureRegistered();
+    return ":/"+getRootFolderPath()+relativePath;
+}
+
+QUrl AppArchiveProvider::resolveUrl(const QString &relativePath)
+{
+    ensureRegistered();
+    return QUrl("qrc:///"+getRootFolderPath()+relativePath);
+}
+
+qint64 AppArchiveProvider::bytesMapped() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_bytesMapped;
+}
+
+void AppArchiveProvider::ensureRegistered()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_registered || m_failed)
+    {
+        return;
+    }
+    // Registering a file maps it into memory where possible
+    if (QResource::registerResource(m_archivePath, mapRoot()))
+    {
+        m_registered = true;
+        m_bytesMapped = QFileInfo(m_archivePath).size();
+    }
+    else
+    {
+        m_failed = true;
+        appCWarning(lcAppResources, m_archivePath) << Q_FUNC_INFO << ": Cannot register the archive "+m_archivePath;
+    }
+}
+
+QString AppArchiveProvider::mapRoot() const
+{
+    return QDir::cleanPath("/"+getRootFolderPath());
+}
@@ -0,0 +1,170 @@
+#ifndef APPRESOURCEPROVIDER_HH
+#define APPRESOURCEPROVIDER_HH
+
+#include <QString>
+#include <QUrl>
+#include <QMap>
+#include <QSharedPointer>
+#include <QMutex>
+#include <QAtomicInt>
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The AppResourceProvider resolves the relative paths of the QML files and
+/// assets of a root folder into paths for QFile and URLs for the QML engine.
+/// A provider is installed per root folder with install(), and
+/// AppWindow::properPath() and AppWindow::properQUrl() use the provider whose
+/// root folder is the longest prefix of the path. Paths without a provider
+/// are resolved from the embedded qrc resources.
+///
+/// The backends are:
+///   -AppQrcProvider: resources compiled into the binary (default)
+///   -AppDirectoryProvider: a plain directory, e.g. during development
+///   -AppArchiveProvider: an external .rcc archive that is memory mapped and
+///    registered on first use, e.g. for content packs
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppResourceProvider
+{
+public:
+    /** Statistics of a provider, or of all of them. */
+    struct Stats
+    {
+        int filesResolved;  ///< Calls to path() and url()
+        qint64 bytesMapped; ///< Size of the mapped archives
+    };
+
+    /***************************************************************************
+     * CONSTRUCTOR AND DESTRUCTOR
+     */
+    AppResourceProvider();
+    virtual ~AppResourceProvider();
+
+    /***************************************************************************
+     * PUBLIC FUNCTIONS
+     */
+    /**
+     * Installs the provider for the root folder, replacing any previous one.
+     * Takes ownership of the provider. The replaced provider is deleted when
+     * the last user of it, e.g. a decoding thread, is done with it.
+     * @param rootFolderPath The root folder, e.g. "qml/" or "" for all paths
+     */
+    static void install(const QString& rootFolderPath, AppResourceProvider* provider);
+
+    /** Returns the provider of the path, kept alive while it is referenced
+     * even if another one is installed meanwhile. */
+    static QSharedPointer<AppResourceProvider> forPath(const QString& path);
+
+    /** Returns the sum of the statistics of the installed providers. */
+    static Stats totalStats();
+
+    /** Returns the root folder the provider is installed for. */
+    QString getRootFolderPath() const {return m_rootFolderPath;}
+
+    /**
+     * Returns a path that can be used in QFiles.
+     * @param path The path, including the root folder
+     */
+    QString path(const QString& path);
+
+    /**
+     * Returns a URL that can be used in QQmlComponents.
+     * @param path The path, including the root folder
+     */
+    QUrl url(const QString& path);
+
+    /** Returns the statistics of this provider. */
+    Stats stats() const;
+
+protected:
+    /***************************************************************************
+     * PROTECTED FUNCTIONS
+     */
+    /** Returns the path of a path relative to the root folder. */
+    virtual QString resolvePath(const QString& relativePath) = 0;
+
+    /** Returns the URL of a path relative to the root folder. */
+    virtual QUrl resolveUrl(const QString& relativePath) = 0;
+
+    /** Returns the number of bytes mapped by this provider. */
+    virtual qint64 bytesMapped() const {return 0;}
+
+private:
+    /** Returns the provider of the paths without an installed provider. */
+    static QSharedPointer<AppResourceProvider> defaultProvider();
+
+    /** Returns the path relative to the root folder. */
+    QString relative(const QString& path) const;
+
+    /***************************************************************************
+     * PRIVATE VARIABLES
+     */
+    QString m_rootFolderPath;
+    QAtomicInt m_filesResolved;
+
+    static QMutex s_mutex;                                  ///< Guards s_providers
+    static QMap<QString, QSharedPointer<AppResourceProvider> > s_providers; ///< The providers by root folder
+};
+
+/** Resolves paths from the resources compiled into the binary. */
+class AppQrcProvider : public AppResourceProvider
+{
+protected:
+    virtual QString resolvePath(const QString& relativePath);
+    virtual QUrl resolveUrl(const QString& relativePath);
+};
+
+/** Resolves paths from a directory of the file system. */
+class AppDirectoryProvider : public AppResourceProvider
+{
+public:
+    /** @param directory The directory that contains the files of the root folder */
+    explicit AppDirectoryProvider(const QString& directory);
+
+protected:
+    virtual QString resolvePath(const QString& relativePath);
+    virtual QUrl resolveUrl(const QString& relativePath);
+
+private:
+    QString m_directory;
+};
+
+/**
+ * Resolves paths from an external .rcc archive built with "rcc -binary". The
+ * archive is registered on first use, which maps the file into memory where
+ * the platform supports it, so its files are read without copying. The files
+ * of the archive appear at the root folder, as if they were compiled in.
+ */
+class AppArchiveProvider : public AppResourceProvider
+{
+public:
+    /** @param archivePath The path of the .rcc file */
+    explicit AppArchiveProvider(const QString& archivePath);
+
+    /** Unregisters the archive. */
+    virtual ~AppArchiveProvider();
+
+    /** Returns true once the archive has been registered. */
+    bool isRegistered() const;
+
+protected:
+    virtual QString resolvePath(const QString& relativePath);
+    virtual QUrl resolveUrl(const QString& relativePath);
+    virtual qint64 bytesMapped() const;
+
+private:
+    /** Registers the archive if it is not yet registered. */
+    void ensureRegistered();
+
+    /** Returns the resource path the archive is registered at. */
+    QString mapRoot() const;
+
+    QString m_archivePath;
+    mutable QMutex m_mutex;     ///< Guards the registration
+    bool m_registered;
+    bool m_failed;              ///< Registration failed, not retried
+    qint64 m_bytesMapped;
+};
+
+#endif // APPRESOURCEPROVIDER_HH
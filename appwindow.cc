@@ -1,7 +1,13 @@
 #include "appwindow.hh"
+#include "appcomponentregistry.hh"
+#include "appitemincubator.hh"
+#include "appmaintenancescheduler.hh"
+#include "appmemorymonitor.hh"
+#include "appresourceprovider.hh"
+#include "appimageprovider.hh"
 #include <QScreen>
 #include <QString>
-#include <QDebug>
+#include "applogging.hh"
 #include <QQmlEngine>
 #include <QQmlContext>
 #include <QQuickItem>
@@ -9,55 +15,123 @@
 #include <QtAlgorithms>
 #include <QQmlIncubator>
 #include <QDir>
+#include <QQmlIncubationController>
+#include <QVector>
+#include <QThread>
+#include <QtCore/private/qabstractanimation_p.h>
+#include <algorithm>
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Incubates a section of a progressively loaded view into its placeholder and
+/// lets the window know when it is done.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+class AppSectionIncubator : public AppItemIncubator
+{
+public:
+    AppSectionIncubator(AppWindow* window, QQuickItem* placeholder)
+        : AppItemIncubator(QVariantMap(), placeholder, Asynchronous)
+        , m_window(window)
+    {
+    }
+
+protected:
+    virtual void statusChanged(Status status)
+    {
+        if (status == Ready || status == Error)
+        {
+            // Queued, as the incubator is deleted when it is processed
+            QMetaObject::invokeMethod(m_window, "processSections", Qt::QueuedConnection);
+        }
+    }
+
+private:
+    AppWindow* m_window;
+};
 
 /*******************************************************************************
  * CONSTRUCTOR AND DESTRUCTOR
 */
+QList<AppWindow*> AppWindow::s_windows;
+
 AppWindow::AppWindow(const QString& rootFolderPath,
                      const QString& mainQML,
                      const QSize& windowSize,
                      const bool center)
-    : QQuickView()
-    , m_rootFolderPath(rootFolderPath)
-    , m_resolution(windowSize)
-    , m_desktopDpiFactor(1)
-    , m_fullScreen(true)
+    : AppWindow(new QQmlApplicationEngine(), true,
+                rootFolderPath, mainQML, windowSize, center)
 {
-    // Set the dpi according to platform
-    QScreen* screen = QGuiApplication::primaryScreen();
-    m_dpi = screen->physicalDotsPerInch();
-    #if !defined(Q_OS_ANDROID)
-        m_dpi = 205;
-    #endif
-    emit dpiChanged();
-
-    // Connect signals here
-    connect(this, SIGNAL(dpiChanged()), this, SIGNAL(touchSizeChanged()));
-    connect(this, SIGNAL(dpiChanged()), this, SIGNAL(textMediumChanged()));
-    connect(this, SIGNAL(dpiChanged()), this, SIGNAL(textLargeChanged()));
-    connect(this, SIGNAL(dpiChanged()), this, SIGNAL(textSmallChanged()));
+}
 
-    // This object can be accessed in Qml with name "app"
-    m_engine.rootContext()->setContextProperty("app", this);
+AppWindow::AppWindow(QQmlEngine* sharedEngine,
+                     const QString& rootFolderPath,
+                     const QString& mainQML,
+                     const QSize& windowSize,
+                     const bool center)
+    : AppWindow(sharedEngine, false,
+                rootFolderPath, mainQML, windowSize, center)
+{
+}
 
-    QQuickWindow::setColor("black");
-    #if !defined(Q_OS_ANDROID)
-        QWindow::resize(windowSize);
-        if (center) {
-            centerWindow();
-        }
-    #endif
-    QQuickView::setResizeMode(QQuickView::SizeRootObjectToView);
+AppWindow::AppWindow(QQmlEngine* engine,
+                     bool ownsEngine,
+                     const QString& rootFolderPath,
+                     const QString& mainQML,
+                     const QSize& windowSize,
+                     const bool center)
+    : QQuickView(engine, 0)
+    , m_rootFolderPath(rootFolderPath)
+    , m_resolution(windowSize)
+    , m_engine(engine)
+    , m_ownsEngine(ownsEngine)
+{
+    initialize(mainQML, windowSize, center);
+}
 
-    // Create the root object
-    m_rootObject = contentItem();
-    loadView(mainQML,QQmlComponent::PreferSynchronous);
-    showView(mainQML);
+AppWindow::AppWindow(QQuickRenderControl* renderControl,
+                     const QString& rootFolderPath,
+                     const QString& mainQML,
+                     const QSize& windowSize)
+    : QQuickView(QUrl(), renderControl)
+    , m_rootFolderPath(rootFolderPath)
+    , m_resolution(windowSize)
+    , m_engine(QQuickView::engine())
+    , m_ownsEngine(false)
+{
+    // The engine of the view is used, and deleted with the view
+    initialize(mainQML, windowSize, false);
 }
 
 AppWindow::~AppWindow()
 {
+    // Stop the workers before the window they may refer to goes away
+    delete m_jobs;
+    for (auto iter = m_views.constBegin(); iter != m_views.constEnd(); ++iter)
+    {
+        cancelSections(iter.key());
+    }
     qDeleteAll(m_views);
+    s_windows.removeOne(this);
+    if (m_ownsEngine)
+    {
+        delete m_context;
+        delete m_engine;
+    }
+    else if (m_engine && m_engine->incubationController() == incubationController())
+    {
+        // Hand the incubation over to another window of the shared engine
+        m_engine->setIncubationController(0);
+        for (auto iter = s_windows.constBegin(); iter != s_windows.constEnd(); ++iter)
+        {
+            if ((*iter)->m_engine == m_engine)
+            {
+                m_engine->setIncubationController((*iter)->incubationController());
+                break;
+            }
+        }
+    }
 }
 
 /*******************************************************************************
@@ -91,12 +165,12 @@ void AppWindow::setFullScreen(bool value)
 {
     if (value == true)
     {
-        qDebug() << Q_FUNC_INFO << ": Entering fullscreen mode";
+        qCDebug(lcAppViews) << Q_FUNC_INFO << ": Entering fullscreen mode";
         QWindow::showFullScreen();
     }
     else
     {
-        qDebug() << Q_FUNC_INFO << ": Entering windowed mode";
+        qCDebug(lcAppViews) << Q_FUNC_INFO << ": Entering windowed mode";
         QWindow::show();
     }
     m_fullScreen = value;
@@ -141,7 +215,7 @@ QObject* AppWindow::getByObjectName(const QString& objectName) const
     QObject* item = m_rootObject->findChild<QObject*>(objectName);
     if (!item)
     {
-        qWarning() << Q_FUNC_INFO << ": " + objectName + " cannot be found!";
+        appCWarning(lcAppLayers, objectName) << Q_FUNC_INFO << ": " + objectName + " cannot be found!";
     }
     return item;
 }
@@ -174,7 +248,12 @@ QQuickItem* AppWindow::rootObject()
 
 QQmlEngine* AppWindow::engine()
 {
-    return &m_engine;
+    return m_engine;
+}
+
+QQmlContext* AppWindow::context() const
+{
+    return m_context;
 }
 
 void AppWindow::centerWindow()
@@ -192,134 +271,274 @@ void AppWindow::centerWindow()
 void AppWindow::loadView(const QString &viewName,
                          QQmlComponent::CompilationMode compilationMode)
 {
+    AppRecorder::Scope recording(m_recorder, AppRecorder::LoadView, viewName);
     if (m_views.contains(viewName))
     {
-        qDebug() << Q_FUNC_INFO << ": The view is already loaded";
+        qCDebug(lcAppViews) << Q_FUNC_INFO << ": The view is already loaded";
     }
     else
     {
-        QQmlComponent component(&m_engine,
-                                properQUrl(m_rootFolderPath+viewName),
-                                compilationMode);
-        QObject::connect(&component,
+        // The compiled view is shared through the registry, so loading the
+        // same view again or in another window does not compile it again
+        QQmlComponent* component = AppComponentRegistry::instance()->acquire(m_engine,
+                                                                             properQUrl(m_rootFolderPath+viewName),
+                                                                             compilationMode);
+        QObject::connect(component,
                          SIGNAL(statusChanged(QQmlComponent::Status)),
                          this,
                          SLOT(viewStatusChanged(QQmlComponent::Status)));
-        QObject::connect(&component,
+        QObject::connect(component,
                          SIGNAL(progressChanged(qreal)),
                          this,
                          SLOT(progressChanged(qreal)));
-        while (component.isLoading())
+        while (component->isLoading())
         {
             QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
         }
-        if (component.status() == QQmlComponent::Ready)
+        if (component->status() == QQmlComponent::Ready)
         {
             QQmlIncubator incubator;
-            component.create(incubator);
-            while (!incubator.isReady())
+            component->create(incubator, m_context);
+            // Driven here as well, as a window without frames, such as a
+            // headless one, would never finish the incubation otherwise
+            QQmlIncubationController* controller = m_engine->incubationController();
+            while (incubator.isLoading())
             {
                 QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+                if (controller)
+                {
+                    controller->incubateFor(5);
+                }
             }
             QQuickItem *view = qobject_cast<QQuickItem*>(incubator.object());
-            m_views[viewName] = view;
-            m_views[viewName]->setParent(rootObject());
+            if (view)
+            {
+                AppComponentRegistry::instance()->trackInstance(component, view);
+                m_views[viewName] = view;
+                m_views[viewName]->setParent(rootObject());
+            }
+            else
+            {
+                qCDebug(lcAppViews) << Q_FUNC_INFO << ": Error in creating view";
+            }
         }
         else
         {
-            qDebug() << Q_FUNC_INFO << ": Error in loading view";
+            qCDebug(lcAppViews) << Q_FUNC_INFO << ": Error in loading view";
         }
+        QObject::disconnect(component, 0, this, 0);
+        AppComponentRegistry::instance()->release(component);
     }
 }
 
+void AppWindow::loadProgressiveView(const QString &viewName, bool show)
+{
+    if (m_recorder)
+    {
+        m_recorder->recordProgressiveView(viewName, show);
+    }
+    AppRecorder::Scope recording(m_recorder);
+    if (m_views.contains(viewName))
+    {
+        qCDebug(lcAppViews) << Q_FUNC_INFO << ": The view is already loaded";
+        if (show)
+        {
+            showView(viewName);
+        }
+        return;
+    }
+    loadView(viewName, QQmlComponent::PreferSynchronous);
+    if (!m_views.contains(viewName))
+    {
+        return;
+    }
+    if (show)
+    {
+        showView(viewName);
+    }
+
+    // Sections inside the window come first, then by their priority
+    struct Placeholder
+    {
+        QQuickItem* item;
+        bool visible;
+        int priority;
+    };
+    QVector<Placeholder> placeholders;
+    QRectF windowRect(0, 0, QWindow::width(), QWindow::height());
+    QList<QQuickItem*> items = m_views[viewName]->findChildren<QQuickItem*>();
+    for (auto iter = items.constBegin(); iter != items.constEnd(); ++iter)
+    {
+        QQuickItem* item = *iter;
+        if (item->property("sectionSource").toString().isEmpty())
+        {
+            continue;
+        }
+        QRectF sceneRect = item->mapRectToScene(QRectF(0, 0, item->width(), item->height()));
+        Placeholder placeholder = {item,
+                                   item->isVisible() && sceneRect.intersects(windowRect),
+                                   item->property("sectionPriority").toInt()};
+        placeholders.append(placeholder);
+    }
+    std::stable_sort(placeholders.begin(), placeholders.end(),
+                     [](const Placeholder& a, const Placeholder& b)
+    {
+        if (a.visible != b.visible)
+        {
+            return a.visible;
+        }
+        return a.priority > b.priority;
+    });
+
+    for (auto iter = placeholders.constBegin(); iter != placeholders.constEnd(); ++iter)
+    {
+        QString source = iter->item->property("sectionSource").toString();
+        PendingSection section;
+        section.viewName = viewName;
+        section.sectionName = iter->item->objectName().isEmpty() ? source : iter->item->objectName();
+        section.placeholder = iter->item;
+        section.component = AppComponentRegistry::instance()->acquire(m_engine,
+                                                                      properQUrl(m_rootFolderPath+source),
+                                                                      QQmlComponent::Asynchronous);
+        section.incubator = 0;
+        if (section.component->isLoading())
+        {
+            QObject::connect(section.component, SIGNAL(statusChanged(QQmlComponent::Status)),
+                             this, SLOT(processSections()));
+        }
+        m_sections.append(section);
+    }
+    if (placeholders.isEmpty())
+    {
+        emit viewCompleted(viewName);
+    }
+    else
+    {
+        processSections();
+    }
+}
+
+bool AppWindow::isViewLoading(const QString &viewName) const
+{
+    for (auto iter = m_sections.constBegin(); iter != m_sections.constEnd(); ++iter)
+    {
+        if (iter->viewName == viewName)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 void AppWindow::switchView(const QString &viewName)
 {
+    AppRecorder::Scope recording(m_recorder, AppRecorder::SwitchView, viewName);
+    qint64 started = m_clock.nsecsElapsed();
     if (showView(viewName))
     {
         for (auto iter = m_views.begin(); iter != m_views.end(); ++iter)
         {
             if (iter.key() != viewName)
             {
-                iter.value()->setParentItem(0);
+                hideViewItem(iter.key(), iter.value());
             }
         }
+        m_switchingView = viewName;
+        m_switchStarted = started;
+        QQuickWindow::update();
     }
     else
     {
-        qDebug() << "AppWindow::switchView(): The view is not loaded";
+        qCDebug(lcAppViews) << "AppWindow::switchView(): The view is not loaded";
     }
 }
 
 void AppWindow::replaceView(const QString &viewName)
 {
+    AppRecorder::Scope recording(m_recorder, AppRecorder::ReplaceView, viewName);
     //Using this retains the currently showed screen until new is loaded
     QQuickWindow::setClearBeforeRendering(false);
     for (auto iter = m_views.begin(); iter != m_views.end(); ++iter)
     {
+        cancelSections(iter.key());
         if (iter.key() != viewName)
         {
             delete *iter;
         }
     }
     m_views.clear();
+    m_hiddenSince.clear();
     loadView(viewName);
     showView(viewName);
     //Return to normal
     QQuickWindow::setClearBeforeRendering(true);
+    m_maintenance->requestMaintenance();
 }
 
 bool AppWindow::showView(const QString &viewName, const QString &layer)
 {
+    AppRecorder::Scope recording(m_recorder, AppRecorder::ShowView, viewName, layer);
     if (!m_views.contains(viewName))
     {
-        qDebug() << "AppWindow::showView(): The view is not loaded";
+        qCDebug(lcAppViews) << "AppWindow::showView(): The view is not loaded";
         return false;
     }
-    if (layer == "")
-    {
-        m_views[viewName]->setParentItem(rootObject());
-    }
-    else
+    QQuickItem *view = m_views[viewName];
+    QQuickItem *itemLayer = rootObject();
+    if (layer != "")
     {
-        QQuickItem *itemLayer = rootObject()->findChild<QQuickItem*>(layer);
-        if (itemLayer)
+        itemLayer = rootObject()->findChild<QQuickItem*>(layer);
+        if (!itemLayer)
         {
-            m_views[viewName]->setParentItem(itemLayer);
-        }
-        else
-        {
-            qDebug() << "AppWindow::showView(): Unknown layer";
+            qCDebug(lcAppLayers) << "AppWindow::showView(): Unknown layer";
+            return true;
         }
     }
+    // A view hidden by visibility is still in its place in the scene
+    if (view->parentItem() != itemLayer)
+    {
+        view->setParentItem(itemLayer);
+    }
+    // Only what hideViewItem() changed is restored, the rest is up to the QML
+    if (m_hiddenSince.remove(viewName) > 0)
+    {
+        view->setVisible(true);
+        view->setEnabled(true);
+    }
+    markActive();
     return true;
 }
 
 bool AppWindow::hideView(const QString &viewName)
 {
+    AppRecorder::Scope recording(m_recorder, AppRecorder::HideView, viewName);
     if (!m_views.contains(viewName))
     {
-        qDebug() << "AppWindow::hideView(): The view is not loaded";
+        qCDebug(lcAppViews) << "AppWindow::hideView(): The view is not loaded";
         return false;
     }
     else
     {
-        m_views[viewName]->setParentItem(0);
+        hideViewItem(viewName, m_views[viewName]);
         return true;
     }
 }
 
-
 bool AppWindow::unloadView(const QString &viewName)
 {
+    AppRecorder::Scope recording(m_recorder, AppRecorder::UnloadView, viewName);
     if (!m_views.contains(viewName))
     {
-        qDebug() << "AppWindow::unloadView(): The view is not loaded";
+        qCDebug(lcAppViews) << "AppWindow::unloadView(): The view is not loaded";
         return false;
     }
     else
     {
+        cancelSections(viewName);
+        m_hiddenSince.remove(viewName);
         m_views[viewName]->deleteLater();
         m_views.remove(viewName);
+        m_maintenance->requestMaintenance();
         return true;
     }
 }
@@ -327,7 +546,7 @@ bool AppWindow::unloadView(const QString &viewName)
 QQuickItem* AppWindow::getView(const QString &viewName) const
 {
     if (!m_views.contains(viewName)) {
-        qDebug() << "AppWindow::getView(): The view is not loaded";
+        qCDebug(lcAppViews) << "AppWindow::getView(): The view is not loaded";
         return 0;
     }
     else
@@ -340,7 +559,7 @@ void AppWindow::forceActiveFocus(const QString &viewName)
 {
     if (!m_views.contains(viewName))
     {
-        qDebug() << "AppWindow::forceActiveFocus(): The view is not loaded";
+        qCDebug(lcAppViews) << "AppWindow::forceActiveFocus(): The view is not loaded";
     }
     else
     {
@@ -350,52 +569,360 @@ void AppWindow::forceActiveFocus(const QString &viewName)
 
 void AppWindow::unloadAllViews()
 {
+    AppRecorder::Scope recording(m_recorder, AppRecorder::UnloadAllViews);
     for (auto iter = m_views.begin(); iter != m_views.end(); ++iter)
     {
+        cancelSections(iter.key());
         (*iter)->deleteLater();
     }
     m_views.clear();
+    m_hiddenSince.clear();
+    m_maintenance->requestMaintenance();
 }
 
 void AppWindow::hideAllViews()
 {
+    AppRecorder::Scope recording(m_recorder, AppRecorder::HideAllViews);
     for (auto iter = m_views.begin(); iter != m_views.end(); ++iter)
     {
-        iter.value()->setParentItem(0);
+        hideViewItem(iter.key(), iter.value());
     }
 }
 
-QString AppWindow::properPath(const QString &path) const
+QStringList AppWindow::getLoadedViews() const
 {
-    return ":/"+path;
+    return m_views.keys();
 }
 
-QUrl AppWindow::properQUrl(const QString &path) const
+void AppWindow::setViewPinned(const QString &viewName, bool pinned)
 {
-    return (QUrl("qrc:///"+path));
+    if (pinned)
+    {
+        m_pinnedViews.insert(viewName);
+    }
+    else
+    {
+        m_pinnedViews.remove(viewName);
+    }
 }
 
-/*******************************************************************************
- * SLOTS
- */
-void AppWindow::viewStatusChanged(QQmlComponent::Status status)
+bool AppWindow::isViewPinned(const QString &viewName) const
+{
+    return m_pinnedViews.contains(viewName);
+}
+
+void AppWindow::setViewSwitchStrategy(const QString &viewName,
+                                      ViewSwitchStrategy strategy)
+{
+    if (strategy == ReparentViews)
+    {
+        m_viewStrategies.remove(viewName);
+    }
+    else
+    {
+        m_viewStrategies[viewName] = strategy;
+    }
+}
+
+AppWindow::ViewSwitchStrategy AppWindow::getViewSwitchStrategy(const QString &viewName) const
+{
+    return m_viewStrategies.value(viewName, ReparentViews);
+}
+
+int AppWindow::releaseHiddenViewResources(int hiddenForMsec)
 {
-    QDebug deb = qDebug();
-    deb << Q_FUNC_INFO << "Asynchronous view loading finished, status is now:";
-    if (status == QQmlComponent::Ready)
+    int released = 0;
+    qint64 now = m_clock.elapsed();
+    for (auto iter = m_hiddenSince.begin(); iter != m_hiddenSince.end();)
+    {
+        QQuickItem *view = m_views.value(iter.key());
+        if (view && now-iter.value() >= hiddenForMsec)
+        {
+            // Leaving the window releases the scene graph nodes of the
+            // subtree, and it is shown again by reparenting like other views
+            view->setParentItem(0);
+            view->setVisible(true);
+            view->setEnabled(true);
+            ++released;
+            iter = m_hiddenSince.erase(iter);
+        }
+        else if (!view)
+        {
+            iter = m_hiddenSince.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+    if (released > 0)
     {
-        deb << "Ready";
+        QQuickWindow::releaseResources();
     }
-    else if (status == QQmlComponent::Error)
+    return released;
+}
+
+qint64 AppWindow::getLastSwitchLatency() const
+{
+    return m_lastSwitchLatency;
+}
+
+void AppWindow::hideViewItem(const QString &viewName, QQuickItem *view)
+{
+    markActive();
+    if (getViewSwitchStrategy(viewName) == ToggleVisibility && view->parentItem())
     {
-        deb << "Error";
+        if (view->isVisible())
+        {
+            view->setVisible(false);
+            view->setEnabled(false);
+            m_hiddenSince[viewName] = m_clock.elapsed();
+        }
     }
     else
     {
-        deb << "Loading or Null";
+        view->setParentItem(0);
+    }
+}
+
+void AppWindow::setFramePacing(FramePacing pacing)
+{
+    m_framePacing = pacing;
+    if (m_framePacing == OnDemandPacing && isRenderLoopThreaded())
+    {
+        appCWarning(lcAppViews, QString()) << Q_FUNC_INFO << ": The threaded render loop is in use, "
+                                              "the frame pacing has no effect";
+    }
+    markActive();
+    QQuickWindow::update();
+}
+
+AppWindow::FramePacing AppWindow::getFramePacing() const
+{
+    return m_framePacing;
+}
+
+void AppWindow::setMaxFrameRate(int framesPerSecond)
+{
+    m_maxFrameRate = framesPerSecond;
+}
+
+void AppWindow::setIdleFrameRate(int framesPerSecond)
+{
+    m_idleFrameRate = framesPerSecond;
+}
+
+void AppWindow::setIdleTimeout(int msec)
+{
+    m_idleTimeout = msec;
+}
+
+quint64 AppWindow::getPostponedUpdates() const
+{
+    return m_postponedUpdates;
+}
+
+quint64 AppWindow::getRenderedFrames() const
+{
+    return m_renderedFrames;
+}
+
+void AppWindow::updateActivity()
+{
+    if (m_activityPending)
+    {
+        m_activityPending = false;
+        m_lastActivity = m_clock.elapsed();
     }
 }
 
+qint64 AppWindow::getIdleTime() const
+{
+    return m_clock.elapsed()-m_lastActivity;
+}
+
+void AppWindow::preferBasicRenderLoop()
+{
+    if (!qEnvironmentVariableIsSet("QSG_RENDER_LOOP"))
+    {
+        qputenv("QSG_RENDER_LOOP", "basic");
+    }
+}
+
+AppMaintenanceScheduler* AppWindow::maintenance() const
+{
+    return m_maintenance;
+}
+
+AppMemoryMonitor* AppWindow::memory() const
+{
+    return m_memory;
+}
+
+AppJobSystem* AppWindow::jobs() const
+{
+    return m_jobs;
+}
+
+AppImageProvider* AppWindow::imageProvider() const
+{
+    return m_imageProvider;
+}
+
+void AppWindow::registerHandler(AppObjectHandler *handler)
+{
+    m_handlers.append(handler);
+}
+
+void AppWindow::unregisterHandler(AppObjectHandler *handler)
+{
+    m_handlers.removeAll(handler);
+}
+
+QList<AppObjectHandler*> AppWindow::getHandlers() const
+{
+    QList<AppObjectHandler*> handlers;
+    for (auto iter = m_handlers.constBegin(); iter != m_handlers.constEnd(); ++iter)
+    {
+        if (!iter->isNull())
+        {
+            handlers.append(iter->data());
+        }
+    }
+    return handlers;
+}
+
+void AppWindow::initialize(const QString &mainQML,
+                           const QSize &windowSize,
+                           const bool center)
+{
+    m_desktopDpiFactor = 1;
+    m_fullScreen = true;
+    m_context = new QQmlContext(m_engine->rootContext(), this);
+    m_switchStarted = 0;
+    m_lastSwitchLatency = 0;
+    m_framePacing = ContinuousPacing;
+    m_maxFrameRate = 60;
+    m_idleFrameRate = 0;
+    m_idleTimeout = 10000;
+    m_activityPending = true;
+    m_lastActivity = 0;
+    m_lastFrameRequest = 0;
+    m_postponedUpdates = 0;
+    m_renderedFrames = 0;
+    m_pacingTimer = new QTimer(this);
+    m_maintenance = new AppMaintenanceScheduler(this);
+    m_memory = new AppMemoryMonitor(this);
+    m_imageProvider = 0;
+    m_recorder = 0;
+    m_jobs = new AppJobSystem(m_engine, this);
+
+    m_clock.start();
+    m_pacingTimer->setSingleShot(true);
+    connect(m_pacingTimer, SIGNAL(timeout()), this, SLOT(pacingTimeout()));
+
+    // Set the dpi according to platform
+    QScreen* screen = QGuiApplication::primaryScreen();
+    m_dpi = screen->physicalDotsPerInch();
+    #if !defined(Q_OS_ANDROID)
+        m_dpi = 205;
+    #endif
+    emit dpiChanged();
+
+    // Connect signals here
+    connect(this, SIGNAL(dpiChanged()), this, SIGNAL(touchSizeChanged()));
+    connect(this, SIGNAL(dpiChanged()), this, SIGNAL(textMediumChanged()));
+    connect(this, SIGNAL(dpiChanged()), this, SIGNAL(textLargeChanged()));
+    connect(this, SIGNAL(dpiChanged()), this, SIGNAL(textSmallChanged()));
+
+    // This object can be accessed in Qml with name "app". The views of each
+    // window are created in its own context, so windows sharing the engine
+    // each see their own metrics.
+    m_context->setContextProperty("app", this);
+    if (m_ownsEngine)
+    {
+        m_engine->rootContext()->setContextProperty("app", this);
+    }
+    s_windows.append(this);
+
+    QQuickWindow::setColor("black");
+    #if !defined(Q_OS_ANDROID)
+        QWindow::resize(windowSize);
+        if (center) {
+            centerWindow();
+        }
+    #endif
+    QQuickView::setResizeMode(QQuickView::SizeRootObjectToView);
+
+    connect(this, SIGNAL(frameSwapped()), this, SLOT(frameRendered()));
+    connect(this, SIGNAL(sceneGraphInitialized()), this, SLOT(sceneGraphReady()), Qt::DirectConnection);
+
+    // Asynchronous incubation is spread over the frames of this window, or of
+    // the first window of a shared engine
+    if (!m_engine->incubationController())
+    {
+        m_engine->setIncubationController(incubationController());
+    }
+
+    // Images are decoded off the GUI thread and shared by all the views of
+    // the engine
+    m_imageProvider = dynamic_cast<AppImageProvider*>(m_engine->imageProvider("app"));
+    if (!m_imageProvider)
+    {
+        m_imageProvider = new AppImageProvider(m_rootFolderPath);
+        m_engine->addImageProvider("app", m_imageProvider);
+    }
+
+    // Create the root object
+    m_rootObject = contentItem();
+    loadView(mainQML,QQmlComponent::PreferSynchronous);
+    showView(mainQML);
+}
+
+void AppWindow::cancelSections(const QString &viewName)
+{
+    for (int i = 0; i < m_sections.size();)
+    {
+        if (m_sections[i].viewName == viewName)
+        {
+            PendingSection section = m_sections.takeAt(i);
+            // Deleting the incubator aborts the incubation
+            delete section.incubator;
+            QObject::disconnect(section.component, 0, this, 0);
+            AppComponentRegistry::instance()->release(section.component);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+QString AppWindow::properPath(const QString &path) const
+{
+    return AppResourceProvider::forPath(path)->path(path);
+}
+
+QUrl AppWindow::properQUrl(const QString &path) const
+{
+    return AppResourceProvider::forPath(path)->url(path);
+}
+
+void AppWindow::setResourceProvider(AppResourceProvider *provider)
+{
+    AppResourceProvider::install(m_rootFolderPath, provider);
+}
+
+/*******************************************************************************
+ * SLOTS
+ */
+void AppWindow::viewStatusChanged(QQmlComponent::Status status)
+{
+    qCDebug(lcAppViews) << Q_FUNC_INFO << "Asynchronous view loading finished, status is now:"
+                        << (status == QQmlComponent::Ready ? "Ready"
+                           : status == QQmlComponent::Error ? "Error" : "Loading or Null");
+}
+
 void AppWindow::updateContentItemHeight()
 {
     contentItem()->setHeight(QWindow::height());
@@ -411,3 +938,153 @@ void AppWindow::progressChanged(qreal progress)
     m_viewLoadProgress = progress;
     emit viewLoadProgressChanged();
 }
+
+/*******************************************************************************
+ * PRIVATE SLOTS
+ */
+void AppWindow::processSections()
+{
+    // The signals are emitted last, as their receivers may unload views
+    QList<QPair<QString, QString> > loadedSections;
+    QStringList touchedViews;
+    for (int i = 0; i < m_sections.size();)
+    {
+        PendingSection& section = m_sections[i];
+        bool finished = false;
+        if (section.incubator == 0 && !section.component->isLoading())
+        {
+            if (section.component->isReady() && section.placeholder)
+            {
+                section.incubator = new AppSectionIncubator(this, section.placeholder);
+                section.component->create(*section.incubator, m_context);
+            }
+            else
+            {
+                qCDebug(lcAppViews) << Q_FUNC_INFO << ": Error in loading section " + section.sectionName;
+                finished = true;
+            }
+        }
+        if (section.incubator && !section.incubator->isLoading())
+        {
+            QObject* object = section.incubator->object();
+            if (object && section.placeholder)
+            {
+                AppComponentRegistry::instance()->trackInstance(section.component, object);
+                loadedSections.append(qMakePair(section.viewName, section.sectionName));
+            }
+            else
+            {
+                qCDebug(lcAppViews) << Q_FUNC_INFO << ": Error in creating section " + section.sectionName;
+                delete object;
+            }
+            finished = true;
+        }
+        if (finished)
+        {
+            PendingSection done = m_sections.takeAt(i);
+            delete done.incubator;
+            QObject::disconnect(done.component, 0, this, 0);
+            AppComponentRegistry::instance()->release(done.component);
+            if (!touchedViews.contains(done.viewName))
+            {
+                touchedViews.append(done.viewName);
+            }
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    for (auto iter = loadedSections.constBegin(); iter != loadedSections.constEnd(); ++iter)
+    {
+        emit viewSectionLoaded(iter->first, iter->second);
+    }
+    for (auto iter = touchedViews.constBegin(); iter != touchedViews.constEnd(); ++iter)
+    {
+        if (!isViewLoading(*iter))
+        {
+            emit viewCompleted(*iter);
+        }
+    }
+}
+
+void AppWindow::frameRendered()
+{
+    ++m_renderedFrames;
+    if (!m_switchingView.isEmpty())
+    {
+        m_lastSwitchLatency = m_clock.nsecsElapsed()-m_switchStarted;
+        QString viewName = m_switchingView;
+        m_switchingView.clear();
+        emit viewSwitched(viewName, m_lastSwitchLatency);
+    }
+}
+
+void AppWindow::pacingTimeout()
+{
+    QWindow::requestUpdate();
+}
+
+void AppWindow::sceneGraphReady()
+{
+    bool threaded = QThread::currentThread() != thread();
+    m_threadedRenderLoop.store(threaded ? 1 : 0);
+    if (threaded && m_framePacing == OnDemandPacing)
+    {
+        appCWarning(lcAppViews, QString()) << Q_FUNC_INFO << ": The threaded render loop is in use, "
+                                              "the frame pacing has no effect";
+    }
+}
+
+/*******************************************************************************
+ * PROTECTED FUNCTIONS
+ */
+bool AppWindow::event(QEvent *event)
+{
+    switch (event->type())
+    {
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease:
+    case QEvent::MouseMove:
+    case QEvent::Wheel:
+    case QEvent::TouchBegin:
+    case QEvent::TouchUpdate:
+    case QEvent::TouchEnd:
+    case QEvent::KeyPress:
+    case QEvent::KeyRelease:
+        markActive();
+        break;
+    case QEvent::UpdateRequest:
+        updateActivity();
+        // The animations of the GUI thread, QML ones included, run on the
+        // unified timer and are never paced
+        if (m_framePacing == OnDemandPacing && QUnifiedTimer::instance()->runningAnimationCount() == 0)
+        {
+            qint64 now = m_clock.elapsed();
+            QQmlIncubationController *controller = m_engine->incubationController();
+            bool incubating = controller && controller->incubatingObjectCount() > 0;
+            bool idle = !incubating && getIdleTime() >= m_idleTimeout;
+            int frameRate = idle ? m_idleFrameRate : m_maxFrameRate;
+            if (frameRate > 0)
+            {
+                qint64 interval = 1000/frameRate;
+                qint64 sinceLastFrame = now-m_lastFrameRequest;
+                if (sinceLastFrame < interval)
+                {
+                    // Postponed, the update is requested again when it is due
+                    ++m_postponedUpdates;
+                    if (!m_pacingTimer->isActive())
+                    {
+                        m_pacingTimer->start(interval-sinceLastFrame);
+                    }
+                    return true;
+                }
+            }
+            m_lastFrameRequest = now;
+        }
+        break;
+    default:
+        break;
+    }
+    return QQuickView::event(event);
+}
@@ -4,7 +4,22 @@
 #include <QQuickView>
 #include <QQmlComponent>
 #include <QQmlApplicationEngine>
+#include <QQmlContext>
 #include <QQuickItem>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QSet>
+#include "appjobsystem.hh"
+
+class AppSectionIncubator;
+class AppObjectHandler;
+class AppMaintenanceScheduler;
+class AppMemoryMonitor;
+class AppResourceProvider;
+class AppImageProvider;
+class AppRecorder;
+class QQuickRenderControl;
 
 ////////////////////////////////////////////////////////////////////////////////
 ///
@@ -23,6 +38,22 @@ class AppWindow : public QQuickView
     Q_OBJECT
 
 public:
+    /** How a view is hidden and shown again. */
+    enum ViewSwitchStrategy
+    {
+        ReparentViews,   ///< Hidden views are removed from the scene (default)
+        ToggleVisibility ///< Hidden views stay in the scene and are toggled with visible and enabled
+    };
+    Q_ENUM(ViewSwitchStrategy)
+
+    /** How often the window renders. */
+    enum FramePacing
+    {
+        ContinuousPacing, ///< Every update request is rendered (default)
+        OnDemandPacing    ///< Update requests are rate limited, optionally lower while idle
+    };
+    Q_ENUM(FramePacing)
+
     /***************************************************************************
      * CONSTRUCTOR AND DESTRUCTOR
      */
@@ -43,6 +74,19 @@ public:
               const QSize& windowSize,
               const bool center=true);
 
+    /** Creates a window that shares the engine with other windows, e.g. for a
+    * second screen. The compiled components, images and the incubation are
+    * shared, while each window has its own views, layers, metrics and
+    * context for "app". The engine must outlive the window.
+    * @param sharedEngine The engine, typically AppWindow::engine() of the
+    * first window
+    */
+    AppWindow(QQmlEngine* sharedEngine,
+              const QString& rootFolderPath,
+              const QString& mainQML,
+              const QSize& windowSize,
+              const bool center=true);
+
     /** Ensures that all the loaded QML views are destroyed. */
     virtual ~AppWindow();
 
@@ -78,6 +122,9 @@ public:
     Q_PROPERTY (qreal viewLoadProgress READ getViewLoadProgress
                 NOTIFY viewLoadProgressChanged)
         qreal getViewLoadProgress();
+    Q_PROPERTY (AppJobSystem* jobs READ jobs CONSTANT)
+        /** Returns the job system that runs heavy work off the GUI thread. */
+        AppJobSystem* jobs() const;
 
     /***************************************************************************
      * PUBLIC FUNCTIONS
@@ -93,6 +140,10 @@ public:
     /** Returns the QQmlEngine of this app */
     QQmlEngine *engine();
 
+    /** Returns the context of this window, where "app" refers to it. The
+     * views and AppObjects of the window are created in it. */
+    QQmlContext *context() const;
+
     /** Centers the window to the middle of the screen. */
     void centerWindow();
 
@@ -126,9 +177,137 @@ public:
     void loadView(const QString& viewName,
                   QQmlComponent::CompilationMode compilationMode =
             QQmlComponent::Asynchronous);
+
+    /** Loads a view progressively. The view file is only the skeleton of the
+     * view: items in it that have the property "sectionSource" set to the path
+     * of a QML file are placeholders for sections. The skeleton is created at
+     * once and shown, and the sections are then incubated over the following
+     * frames into their placeholders, sections inside the window first and
+     * then by the optional "sectionPriority" property (higher first).
+     * viewSectionLoaded() is emitted for each section and viewCompleted()
+     * when all the sections are done.
+     * @param viewName The url of the loaded view.
+     * @param show Whether the view is shown as soon as the skeleton is ready.
+     */
+    void loadProgressiveView(const QString& viewName, bool show=true);
+
+    /** Returns true while sections of the view are still being incubated. */
+    bool isViewLoading(const QString& viewName) const;
+
     bool unloadView(const QString& viewName);
     void unloadAllViews();
     void hideAllViews();
+
+    /** Returns the names of the loaded views. */
+    QStringList getLoadedViews() const;
+
+    /** Pins the view, which keeps it loaded when the memory monitor unloads
+     * hidden views to get under the memory budget.
+     * @param viewName The url of the view, which does not need to be loaded.
+     * @param pinned Whether the view is pinned.
+     */
+    void setViewPinned(const QString& viewName, bool pinned=true);
+    bool isViewPinned(const QString& viewName) const;
+
+    /** Sets how the view is hidden and shown. Views that are switched often
+     * should toggle their visibility, so that their scene graph subtree and
+     * layout are not rebuilt every time they are shown again.
+     * @param viewName The url of the view, which does not need to be loaded.
+     * @param strategy The strategy used for the view.
+     */
+    void setViewSwitchStrategy(const QString& viewName,
+                               ViewSwitchStrategy strategy);
+    ViewSwitchStrategy getViewSwitchStrategy(const QString& viewName) const;
+
+    /** Removes the views that have been hidden by toggling their visibility
+     * for at least the given time from the scene, which releases their scene
+     * graph resources. They are put back when shown again.
+     * @param hiddenForMsec How long a view must have been hidden.
+     * @return The number of views whose resources were released.
+     */
+    int releaseHiddenViewResources(int hiddenForMsec);
+
+    /** Returns the time in nanoseconds from the last switchView() call to the
+     * first frame showing the view. */
+    qint64 getLastSwitchLatency() const;
+
+    /** Sets the frame pacing. Qt Quick renders only when the scene requests
+     * an update; OnDemandPacing caps the rate of those requests at
+     * maxFrameRate per second while the app is active, and at idleFrameRate
+     * when nothing has changed for idleTimeout. AppObject and view changes,
+     * input and incubation count as activity. The pacing is suspended while
+     * animations are running, so they keep their frame rate. The pacing acts
+     * on the update requests of the window, which only drive the basic
+     * render loop: the windows render loop is driven by a timer and the
+     * threaded one animates on its own thread, so the pacing has no effect
+     * there. A warning is logged for the threaded loop; call
+     * preferBasicRenderLoop() before creating the first window.
+     */
+    void setFramePacing(FramePacing pacing);
+    FramePacing getFramePacing() const;
+
+    /** Sets the frame rate cap of the active app, 0 for no cap. */
+    void setMaxFrameRate(int framesPerSecond);
+
+    /** Sets the frame rate of the idle app, 0 for no cap (default). */
+    void setIdleFrameRate(int framesPerSecond);
+
+    /** Sets how long the app must be without activity to be idle. */
+    void setIdleTimeout(int msec);
+
+    /** Marks the app active for the on-demand pacing. Cheap enough to call
+     * on every change. */
+    void markActive() {m_activityPending = true;}
+
+    /** Returns the number of update requests the pacing has postponed.
+     * A postponed request is rendered later, so no frame is lost. */
+    quint64 getPostponedUpdates() const;
+
+    /** Returns the number of frames rendered. */
+    quint64 getRenderedFrames() const;
+
+    /** Takes the activity marked since the previous call into account in
+     * getIdleTime(). Called on every update request and by the maintenance
+     * scheduler. */
+    void updateActivity();
+
+    /** Returns the milliseconds since the last activity (see markActive()),
+     * as of the last updateActivity(). */
+    qint64 getIdleTime() const;
+
+    /** Returns true if the scene graph renders on its own thread, which is
+     * known once the scene graph is initialized. */
+    bool isRenderLoopThreaded() const {return m_threadedRenderLoop.load() != 0;}
+
+    /** Selects the basic render loop, under which the frame pacing works,
+     * unless QSG_RENDER_LOOP is set. Must be called before the first window
+     * is created. */
+    static void preferBasicRenderLoop();
+
+    /** Returns the scheduler that runs memory maintenance while the app is
+     * idle. A pass is requested automatically when views are unloaded. */
+    AppMaintenanceScheduler* maintenance() const;
+
+    /** Returns the monitor that accounts the memory of the caches and trims
+     * them under a budget or on low memory. */
+    AppMemoryMonitor* memory() const;
+
+    /** Returns the provider that decodes the "image://app/" images of the
+     * engine in the background and caches them. */
+    AppImageProvider* imageProvider() const;
+
+    /** Returns the AppRecorder recording the window, or null. */
+    AppRecorder* recorder() const {return m_recorder;}
+
+    /** Called by AppRecorder::start() and stop(). */
+    void setRecorder(AppRecorder* recorder) {m_recorder = recorder;}
+
+    /** Called by the AppObjectHandlers showing their objects in this window. */
+    void registerHandler(AppObjectHandler* handler);
+    void unregisterHandler(AppObjectHandler* handler);
+
+    /** Returns the live AppObjectHandlers of this window. */
+    QList<AppObjectHandler*> getHandlers() const;
     QString getRootFolderPath() const;
 
     /** Returns a QObject pointer to a QQuickItem with the given objectName.
@@ -151,14 +330,26 @@ public:
      */
     void forceActiveFocus(const QString& viewName);
 
+    /** Installs the provider that resolves the paths of the root folder,
+     * e.g. an AppDirectoryProvider or AppArchiveProvider. The embedded qrc
+     * resources are used by default. Takes ownership of the provider, which
+     * is shared by all the windows with the same root folder. The main QML
+     * file is loaded in the constructor, so to load it through the provider
+     * install it with AppResourceProvider::install() before the window is
+     * created.
+     */
+    void setResourceProvider(AppResourceProvider* provider);
+
     /** Used to create a valid, environment indepedendent QString from a
      * relative path. Returns a QString that can be used e.g. in QFiles.
+     * The path is resolved by the AppResourceProvider of its root folder.
      * @param path The path that is modified.
      */
     QString properPath(const QString& path) const;
 
     /** Used to create a valid, environment indepedendet QUrl from a
      * relative path. Returns a QUrl that can be used e.g. in QQmlComponents.
+     * The path is resolved by the AppResourceProvider of its root folder.
      * @param path The path that is modified.
      */
     QUrl properQUrl(const QString& path) const;
@@ -177,6 +368,9 @@ signals:
     void textLargeChanged();
     void fullScreenChanged();
     void viewLoadProgressChanged();
+    void viewSectionLoaded(const QString& viewName, const QString& sectionName);
+    void viewCompleted(const QString& viewName);
+    void viewSwitched(const QString& viewName, qint64 latencyNsec);
 
 public slots:
     /***************************************************************************
@@ -187,7 +381,71 @@ public slots:
     void updateContentItemHeight();
     void updateContentItemWidth();
 
+private slots:
+    /***************************************************************************
+     * PRIVATE SLOTS
+     */
+    /** Starts the sections whose component is ready and finishes the
+     * incubated ones. */
+    void processSections();
+
+    /** Counts the frame and reports the latency of a pending view switch. */
+    void frameRendered();
+
+    /** Requests the update postponed by the frame pacing. */
+    void pacingTimeout();
+
+    /** Detects the render loop, called on the render thread. */
+    void sceneGraphReady();
+
+protected:
+    /***************************************************************************
+     * PROTECTED FUNCTIONS
+     */
+    /** Creates a window that is rendered through the render control instead
+    * of being shown, see AppHeadlessWindow. It uses the engine of the view.
+    */
+    AppWindow(QQuickRenderControl* renderControl,
+              const QString& rootFolderPath,
+              const QString& mainQML,
+              const QSize& windowSize);
+
+    /** Tracks input activity and applies the frame pacing. */
+    virtual bool event(QEvent* event);
+
 private:
+    /** A section of a progressively loaded view that is not yet created. */
+    struct PendingSection
+    {
+        QString viewName;
+        QString sectionName;
+        QPointer<QQuickItem> placeholder;
+        QQmlComponent* component;
+        AppSectionIncubator* incubator;
+    };
+
+    /***************************************************************************
+     * PRIVATE FUNCTIONS
+     */
+    AppWindow(QQmlEngine* engine,
+              bool ownsEngine,
+              const QString& rootFolderPath,
+              const QString& mainQML,
+              const QSize& windowSize,
+              const bool center);
+
+    /** Sets up the window and loads the main view. Shared by the
+    * constructors, as they construct the view differently. */
+    void initialize(const QString& mainQML,
+                    const QSize& windowSize,
+                    const bool center);
+
+    /** Aborts the incubation of the remaining sections of the view. */
+    void cancelSections(const QString& viewName);
+
+    /** Hides the view with the strategy of the view. */
+    void hideViewItem(const QString& viewName, QQuickItem* view);
+
     /***************************************************************************
      * PRIVATE VARIABLES
      */
@@ -197,9 +455,38 @@ private:
     float m_dpi;                            ///< The DPI of the screen
     float m_desktopDpiFactor;               ///< When the app is run on desktop the dpi is multiplied by this factor
     bool m_fullScreen;
-    QQmlApplicationEngine m_engine;
+    QPointer<QQmlEngine> m_engine;
+    bool m_ownsEngine;                      ///< False for a shared engine
+    QQmlContext* m_context;                 ///< The context of the views of this window
     QQuickItem* m_rootObject;
     qreal m_viewLoadProgress;
+    QList<PendingSection> m_sections;       ///< Sections of progressive views waiting to be created
+    QHash<QString,ViewSwitchStrategy> m_viewStrategies;  ///< Views that do not use the default strategy
+    QHash<QString,qint64> m_hiddenSince;    ///< When the views hidden by visibility were hidden
+    QElapsedTimer m_clock;                  ///< Time base of the view switching
+    QString m_switchingView;                ///< The view of a switch waiting for its frame
+    qint64 m_switchStarted;
+    qint64 m_lastSwitchLatency;
+    FramePacing m_framePacing;
+    int m_maxFrameRate;
+    int m_idleFrameRate;
+    int m_idleTimeout;                      ///< Milliseconds without activity before the app is idle
+    bool m_activityPending;                 ///< Set by markActive(), read on the next update request
+    qint64 m_lastActivity;                  ///< Milliseconds on m_clock
+    qint64 m_lastFrameRequest;              ///< Milliseconds on m_clock
+    quint64 m_postponedUpdates;
+    quint64 m_renderedFrames;
+    QTimer* m_pacingTimer;
+    QAtomicInt m_threadedRenderLoop;        ///< Set on the render thread by sceneGraphReady()
+    AppMaintenanceScheduler* m_maintenance;
+    AppMemoryMonitor* m_memory;
+    AppImageProvider* m_imageProvider;      ///< Owned by m_engine, shared by its windows
+    AppJobSystem* m_jobs;
+    AppRecorder* m_recorder;
+    QSet<QString> m_pinnedViews;            ///< Views kept loaded under memory pressure
+
+    static QList<AppWindow*> s_windows;     ///< The live windows, for handing over a shared engine
+    QList<QPointer<AppObjectHandler> > m_handlers;  ///< Guarded, as handlers do not unregister
 };
 
 #endif // APPWINDOW_HH